@@ -0,0 +1,292 @@
+// Microbenchmarks for the hot paths between the shared buffers and the ingestors.
+// Prints one CSV line per benchmark, normalized per operation, so runs can be diffed or plotted.
+//
+// Usage: ./MonitorBench [name-substring]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "Bench/PerfCounters.h"
+#include "Collector/ChunkCodec.h"
+#include "Collector/ChunkPool.h"
+#include "Collector/Collector.h"
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Core/SharedMemory.h"
+#include "Ingestor/Decoder.h"
+#include "Tools/FakeProducer.h"
+
+
+using namespace Monitor;
+
+static const char* filter = nullptr;
+static bool failed = false;   // a benchmark didn't do the work it measures
+
+template <typename T>
+static inline void DoNotOptimize(T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs `body`, which performs `num_ops` operations, and reports its cost per operation. `setup`
+// and `teardown` run before and after every call of `body`, outside of the measurement.
+template <typename S, typename F, typename T>
+static void Measure(const char* name, u64 num_ops, S&& setup, F&& body, T&& teardown) {
+  if (filter != nullptr && strstr(name, filter) == nullptr) return;
+
+  PerfCounters counters;
+  setup();
+  body();   // warm up caches and the branch predictor
+  teardown();
+
+  setup();
+  auto start = std::chrono::steady_clock::now();
+  counters.Start();
+  body();
+  PerfCounters::Values values = counters.Stop();
+  auto end = std::chrono::steady_clock::now();
+  teardown();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("%s,%lu,%.3f", name, num_ops, ns / num_ops);
+  for (int i = 0; i < PerfCounters::kNumCounters; ++i) {
+    if (counters.IsAvailable()) printf(",%.3f", (double)values.counts[i] / num_ops);
+    else printf(",");
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+template <typename S, typename F>
+static void Measure(const char* name, u64 num_ops, S&& setup, F&& body) {
+  Measure(name, num_ops, setup, body, [] {});
+}
+
+template <typename F>
+static void Measure(const char* name, u64 num_ops, F&& body) {
+  Measure(name, num_ops, [] {}, body, [] {});
+}
+
+// Pins the calling thread to the `i`th CPU it may run on, wrapping around when there are fewer.
+// Returns whether it got a CPU of its own.
+static bool PinThread(u32 i) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  u32 num_allowed = CPU_COUNT(&allowed);
+  u32 nth = i % num_allowed;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed) || nth-- != 0) continue;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && i < num_allowed;
+  }
+  return false;
+}
+
+// A repeating mix of events with their args, roughly what an instrumented program produces.
+static std::vector<LoggedEvent> MakeEventStream(u32 num_words) {
+  static const EventType kMix[] = { READ, READ, WRITE, READ, ATOMICLOAD, WRITE, ACQUIRE, RELEASE,
+                                    READ, ATOMICRMW, WRITE, RETURN };
+  std::vector<LoggedEvent> stream;
+  u64 i = 0;
+  while (stream.size() < num_words) {
+    EventType type = kMix[i % (sizeof(kMix) / sizeof(kMix[0]))];
+    LoggedEvent event = RawEvent(0);
+    event.event_type = type;
+    stream.push_back(event);
+    stream.push_back(RawEvent(0x7f0000001000 + (i % 4096) * 8));
+    for (int arg = 1; arg < EventNumArgs(type); ++arg) stream.push_back(RawEvent(i + arg));
+    i++;
+  }
+  // Only keep whole events.
+  while (stream.size() > num_words) stream.pop_back();
+  u32 end = 0;
+  for (u32 j = 0; j < stream.size(); j += 1 + EventNumArgs(stream[j].event_type)) {
+    if (j + 1 + EventNumArgs(stream[j].event_type) > stream.size()) break;
+    end = j + 1 + EventNumArgs(stream[j].event_type);
+  }
+  stream.resize(end);
+  return stream;
+}
+
+static void BenchSharedMemory(SharedMemory& shm, int pid) {
+  constexpr u32 kNumOps = 200000;
+  shm.Open(0);
+  FakeProducer producer(pid, 0);
+  for (u32 i = 0; i < kBufferNumEvents; ++i) producer.buf[i].store(RawEvent(i + 1));
+
+  std::unique_ptr<Chunk> chunk(new Chunk());
+  u32 num_missed = 0;
+  Measure("shm_maybe_consume_chunk", kNumOps, [&] {
+    for (u32 i = 0; i < kNumOps; ++i) {
+      num_missed += !shm.MaybeConsumeChunk(0, chunk.get());
+      // Play the producer: refill the entry the consumer just cleared.
+      u32 cleared = (i * Chunk::kChunkNumEvents) % kBufferNumEvents;
+      producer.buf[cleared].store(RawEvent(1));
+      DoNotOptimize(*chunk);
+    }
+  });
+  if (num_missed != 0) {
+    fprintf(stderr, "[!] shm_maybe_consume_chunk: %u calls found no chunk\n", num_missed);
+    failed = true;
+  }
+
+  Measure("chunk_copy", kNumOps, [&] {
+    for (u32 i = 0; i < kNumOps; ++i) {
+      new (chunk.get()) Chunk(0, producer.buf, (i * Chunk::kChunkNumEvents) % kBufferNumEvents);
+      DoNotOptimize(*chunk);
+    }
+  });
+  shm.Close(0);
+}
+
+static void BenchDecoding() {
+  constexpr u32 kNumChunks = 256;
+  std::vector<LoggedEvent> stream = MakeEventStream(kNumChunks * Chunk::kChunkNumEvents);
+  std::vector<AMEvent> buf(kNumChunks * Chunk::kChunkNumEvents);
+  for (u32 i = 0; i < stream.size(); ++i) buf[i].store(stream[i]);
+  std::vector<Chunk> pristine;
+  for (u32 i = 0; i < kNumChunks; ++i) pristine.emplace_back(0, buf.data(), i * Chunk::kChunkNumEvents);
+  std::vector<Chunk> chunks = pristine;
+
+  // Rewinds the chunks' cursors.
+  auto rewind = [&] { chunks = pristine; };
+  Measure("chunk_next", kNumChunks * Chunk::kChunkNumEvents, rewind, [&] {
+    u64 sum = 0;
+    for (Chunk& chunk : chunks)
+      while (auto event = chunk.Next()) sum += event->raw;
+    DoNotOptimize(sum);
+  });
+
+  Measure("event_num_args_make_event", stream.size(), [&] {
+    u64 sum = 0;
+    for (u32 i = 0; i < stream.size(); ) {
+      int num_args = EventNumArgs(stream[i].event_type);
+      IngestorEvent event = MakeIngestorEvent(&stream[i]);
+      sum += event.addr.value_or(0);
+      i += 1 + num_args;
+    }
+    DoNotOptimize(sum);
+  });
+
+  std::vector<u8> packed(sizeof(Chunk) * kNumChunks);
+  std::vector<u32> offsets(kNumChunks + 1, 0);
+  auto compress = [&] {
+    for (u32 i = 0; i < kNumChunks; ++i)
+      offsets[i + 1] = offsets[i] + ChunkCodec::Compress(pristine[i], &packed[offsets[i]], sizeof(Chunk));
+  };
+  Measure("chunk_compress", stream.size(), compress);
+  if (offsets[kNumChunks] != 0)
+    fprintf(stderr, "[+] chunk_compress: %.2fx\n", (double)kNumChunks * Chunk::kChunkSize / offsets[kNumChunks]);
+
+  std::unique_ptr<Chunk> unpacked(new Chunk());
+  // Needs chunk_compress's output, even when that one is filtered out.
+  auto ensure_compressed = [&] { if (offsets[kNumChunks] == 0) compress(); };
+  Measure("chunk_decompress", stream.size(), ensure_compressed, [&] {
+    for (u32 i = 0; i < kNumChunks; ++i) {
+      ChunkCodec::Decompress(&packed[offsets[i]], unpacked.get());
+      DoNotOptimize(*unpacked);
+    }
+  });
+
+  std::unique_ptr<Decoder> decoder(new Decoder());
+  Measure("decoder_feed", stream.size(), [&] {
+    u64 sum = 0;
+    for (Chunk& chunk : pristine)
+      decoder->Feed(chunk, [&sum](TraceId, IngestorEvent& event) { sum += event.addr.value_or(0); });
+    DoNotOptimize(sum);
+  });
+}
+
+// Chunks travelling from a collector thread to the ingestor thread calling Take, once both are running.
+// Counters are for the ingestor side. The producer, collector and ingestor threads are pinned to
+// different CPUs where there are enough of them.
+static void BenchCollectorHandoff(SharedMemory& shm, int pid) {
+  constexpr u32 kNumChunks = 4000;
+  constexpr int kBenchTraces = 4;
+  TraceId trace_ids[kBenchTraces] = { 1, 2, 3, 4 };
+
+  for (TraceId trace_id : trace_ids) shm.Open(trace_id);
+  std::vector<std::unique_ptr<FakeProducer>> producers;
+  for (TraceId trace_id : trace_ids) producers.emplace_back(new FakeProducer(pid, trace_id));
+  ChunkPool pool;
+  PinThread(0);
+  std::atomic<bool> shares_cpus(false);
+
+  std::unique_ptr<Collector> collector;
+  std::atomic<bool> stop_producing(false);
+  std::thread producer_thread, collector_thread;
+  u32 num_taken = 0;
+  auto start = [&] {
+    collector.reset(new Collector(shm, pool, trace_ids, kBenchTraces, 1000000));
+    stop_producing = false;
+    producer_thread = std::thread([&] {
+      if (!PinThread(1)) shares_cpus = true;
+      u64 i = 0;
+      while (!stop_producing) {
+        for (auto& producer : producers) {
+          for (int j = 0; j < 64; ++j) producer->TryPut(RawEvent(++i));
+        }
+      }
+    });
+    collector_thread = std::thread([&] {
+      if (!PinThread(2)) shares_cpus = true;
+      collector->Run();
+    });
+    // Wait for the first chunk, so that the measurement starts with the pipeline flowing.
+    if (Chunk* chunk = collector->Take()) collector->Release(chunk);
+  };
+  auto stop = [&] {
+    stop_producing = true;
+    producer_thread.join();
+    collector->Stop();
+    while (Chunk* chunk = collector->Take()) collector->Release(chunk);
+    collector_thread.join();
+    collector.reset();
+  };
+
+  Measure("collector_take_release", kNumChunks, start, [&] {
+    for (u32 i = 0; i < kNumChunks; ++i) {
+      Chunk* chunk = collector->Take();
+      if (chunk == nullptr) break;
+      DoNotOptimize(*chunk);
+      collector->Release(chunk);
+      num_taken++;
+    }
+  }, stop);
+  if (num_taken % kNumChunks != 0) {
+    fprintf(stderr, "[!] collector_take_release: the collector stopped early\n");
+    failed = true;
+  }
+  if (shares_cpus) fprintf(stderr, "[!] collector_take_release: fewer than 3 CPUs, the threads share them\n");
+
+  for (TraceId trace_id : trace_ids) shm.Close(trace_id);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) filter = argv[1];
+
+  // SharedMemory expects the directory the instrumented program would have created, and removes
+  // it when destroyed.
+  int pid = getpid();
+  FakeProducer::CreateDir(pid);
+  SharedMemory shm(pid);
+
+  printf("name,ops,ns_per_op,cycles_per_op,instructions_per_op,cache_misses_per_op,branch_misses_per_op\n");
+  BenchSharedMemory(shm, pid);
+  BenchDecoding();
+  BenchCollectorHandoff(shm, pid);
+
+  if (!PerfCounters().IsAvailable())
+    fprintf(stderr, "[!] perf_event_open unavailable, only timings are reported\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#ifndef MONITOR_PERFCOUNTERS_H
+#define MONITOR_PERFCOUNTERS_H
+
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Common/Types.h"
+
+namespace Monitor {
+
+/** Hardware counters for the calling thread, read as a single perf_event_open group.
+ *  If the kernel refuses (e.g. perf_event_paranoid, or no PMU in a VM), IsAvailable() is false
+ *  and every counter reads as 0.
+ */
+class PerfCounters {
+public:
+  enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, kNumCounters };
+
+  struct Values {
+    u64 counts[kNumCounters];
+  };
+
+  PerfCounters() {
+    static const u64 kConfigs[kNumCounters] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (int i = 0; i < kNumCounters; ++i) fds[i] = -1;
+
+    for (int i = 0; i < kNumCounters; ++i) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = kConfigs[i];
+      attr.disabled = i == 0;   // the group leader starts and stops everything
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+      if (fds[i] < 0) {
+        Close();
+        return;
+      }
+    }
+  }
+
+  ~PerfCounters() { Close(); }
+
+  bool IsAvailable() const { return fds[0] >= 0; }
+
+  void Start() {
+    if (!IsAvailable()) return;
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  Values Stop() {
+    Values values = {};
+    if (!IsAvailable()) return values;
+    ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    struct { u64 nr; u64 counts[kNumCounters]; } group;
+    if (read(fds[0], &group, sizeof(group)) == sizeof(group))
+      for (int i = 0; i < kNumCounters; ++i) values.counts[i] = group.counts[i];
+    return values;
+  }
+
+private:
+  void Close() {
+    for (int i = kNumCounters - 1; i >= 0; --i) {
+      if (fds[i] >= 0) close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+
+  int fds[kNumCounters];
+};
+
+}   // namespace Monitor
+
+#endif
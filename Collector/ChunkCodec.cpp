@@ -0,0 +1,70 @@
+#include "ChunkCodec.h"
+
+#include <cstring>
+
+
+namespace Monitor {
+static inline u64 Zigzag(u64 delta) { return (delta << 1) ^ (u64)((int64_t)delta >> 63); }
+static inline u64 Unzigzag(u64 zz) { return (zz >> 1) ^ -(zz & 1); }
+
+u32 ChunkCodec::Compress(const Chunk& chunk, u8* out, u32 capacity) {
+  if (capacity < sizeof(Header)) return 0;
+  u8* p = out + sizeof(Header);
+  u8* end = out + capacity;
+
+  u64 history[kHistorySize] = {};
+  u32 next_slot = 0;
+  const LoggedEvent* events = chunk.Data();
+  for (u32 i = chunk.cursor_; i < chunk.num_events_; ++i) {
+    u64 word = events[i].raw;
+    u32 best = 0;
+    u64 best_zz = Zigzag(word - history[0]);
+    for (u32 slot = 1; slot < kHistorySize; ++slot) {
+      u64 zz = Zigzag(word - history[slot]);
+      if (zz < best_zz) {
+        best = slot;
+        best_zz = zz;
+      }
+    }
+
+    u32 num_bytes = best_zz ? (64 - __builtin_clzll(best_zz) + 7) / 8 : 0;
+    if (p + 1 + num_bytes > end) return 0;
+    *p++ = num_bytes << 3 | best;
+    for (u32 b = 0; b < num_bytes; ++b) *p++ = best_zz >> (8 * b);
+
+    // Exact repeats are already in the history, keep it diverse.
+    if (best_zz != 0) history[next_slot++ % kHistorySize] = word;
+  }
+
+  Header header = { chunk.produced_tsc_, chunk.collected_tsc_, chunk.trace_id_, chunk.num_events_ - chunk.cursor_,
+                    (u32)(p - out - sizeof(Header)), 0 };
+  memcpy(out, &header, sizeof(Header));
+  return p - out;
+}
+
+u32 ChunkCodec::Decompress(const u8* in, Chunk* out) {
+  Header header;
+  memcpy(&header, in, sizeof(Header));
+  const u8* p = in + sizeof(Header);
+
+  u64 history[kHistorySize] = {};
+  u32 next_slot = 0;
+  for (u32 i = 0; i < header.num_events; ++i) {
+    u8 tag = *p++;
+    u32 num_bytes = tag >> 3;
+    u64 zz = 0;
+    for (u32 b = 0; b < num_bytes; ++b) zz |= (u64)*p++ << (8 * b);
+    u64 word = history[tag & (kHistorySize - 1)] + Unzigzag(zz);
+    out->events_[i].raw = word;
+    if (zz != 0) history[next_slot++ % kHistorySize] = word;
+  }
+
+  out->trace_id_ = header.trace_id;
+  out->num_events_ = header.num_events;
+  out->cursor_ = 0;
+  out->produced_tsc_ = header.produced_tsc;
+  out->collected_tsc_ = header.collected_tsc;
+  return sizeof(Header) + header.payload_bytes;
+}
+
+}   // namespace Monitor
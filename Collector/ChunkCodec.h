@@ -0,0 +1,40 @@
+#ifndef MONITOR_CHUNKCODEC_H
+#define MONITOR_CHUNKCODEC_H
+
+#include "Common/Event.h"
+#include "Common/Types.h"
+
+
+namespace Monitor {
+
+/** Compact encoding of chunks that have to wait in memory for an ingestor.
+ *  Each word is coded as a delta from whichever of the last kHistorySize distinct words makes it
+ *  smallest: a tag byte with the history slot and the length of the delta, then the zigzagged
+ *  delta in little endian. Repeated event headers, nearby addresses and small values all take
+ *  one to three bytes. Events are not parsed, since a chunk may start in the middle of one.
+ */
+class ChunkCodec {
+public:
+  static constexpr u32 kHistorySize = 8;
+
+  // Precedes the encoded words.
+  struct Header {
+    u64 produced_tsc;
+    u64 collected_tsc;
+    TraceId trace_id;
+    u32 num_events;
+    u32 payload_bytes;
+    u32 reserved;
+  };
+  static_assert(sizeof(Header) % sizeof(u64) == 0);
+
+  // Writes `chunk`'s unread events to `out`. Returns the number of bytes written, or 0 if they
+  // don't fit in `capacity` bytes.
+  static u32 Compress(const Chunk& chunk, u8* out, u32 capacity);
+  // Restores a chunk written by `Compress` into `out`. Returns the number of bytes read.
+  static u32 Decompress(const u8* in, Chunk* out);
+};
+
+}   // namespace Monitor
+
+#endif
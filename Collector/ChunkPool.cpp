@@ -0,0 +1,44 @@
+#include "ChunkPool.h"
+
+#include <algorithm>
+
+
+namespace Monitor {
+ChunkPool::ChunkPool(size_t max_bytes) :
+  max_chunks(max_bytes / sizeof(Chunk)), num_allocated(0), num_free(0) {
+  free_chunks.reserve(max_chunks);
+}
+
+bool ChunkPool::Grow() {
+  size_t allocated = num_allocated.load(std::memory_order_relaxed);
+  if (allocated >= max_chunks) return false;
+
+  size_t n = std::min<size_t>(kChunksPerSlab, max_chunks - allocated);
+  slabs.emplace_back(new Chunk[n]);
+  Chunk* slab = slabs.back().get();
+  for (size_t i = 0; i < n; ++i) free_chunks.push_back(&slab[i]);
+  num_allocated.store(allocated + n, std::memory_order_relaxed);
+  return true;
+}
+
+u32 ChunkPool::AllocateBatch(Chunk** out, u32 n) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (free_chunks.size() < n) Grow();
+
+  u32 num_taken = 0;
+  while (num_taken < n && !free_chunks.empty()) {
+    out[num_taken++] = free_chunks.back();
+    free_chunks.pop_back();
+  }
+  num_free.store(free_chunks.size(), std::memory_order_relaxed);
+  return num_taken;
+}
+
+void ChunkPool::ReleaseBatch(Chunk** chunks, u32 n) {
+  if (n == 0) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (u32 i = 0; i < n; ++i) free_chunks.push_back(chunks[i]);
+  num_free.store(free_chunks.size(), std::memory_order_relaxed);
+}
+
+}   // namespace Monitor
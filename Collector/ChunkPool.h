@@ -0,0 +1,95 @@
+#ifndef MONITOR_CHUNKPOOL_H
+#define MONITOR_CHUNKPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+
+
+namespace Monitor {
+
+/** Global pool of chunks shared by all collectors and ingestors.
+ *  Memory is allocated in slabs on demand, up to a cap. Released chunks go back to the pool so
+ *  they can be reused by whichever worker is busiest. Threads never touch the pool directly on
+ *  the hot path; they go through a ChunkCache which batches transfers to and from the pool.
+ */
+class ChunkPool {
+public:
+  static constexpr u32 kChunksPerSlab = 64;
+  static constexpr u32 kBatchSize = 16;
+
+  ChunkPool(size_t max_bytes = kDefaultChunkPoolBytes);
+  ChunkPool(const ChunkPool&) = delete;
+  ChunkPool& operator=(const ChunkPool&) = delete;
+
+  // Moves up to n free chunks into out, growing the pool if allowed. Returns the number moved.
+  u32 AllocateBatch(Chunk** out, u32 n);
+  void ReleaseBatch(Chunk** chunks, u32 n);
+
+  size_t MaxChunks() const { return max_chunks; }
+  size_t NumAllocatedChunks() const { return num_allocated.load(std::memory_order_relaxed); }
+  // Chunks handed out, including those sitting in ChunkCaches.
+  size_t NumChunksInUse() const {
+    return num_allocated.load(std::memory_order_relaxed) - num_free.load(std::memory_order_relaxed);
+  }
+
+private:
+  bool Grow();
+
+  const size_t max_chunks;
+  std::atomic<size_t> num_allocated;
+  std::atomic<size_t> num_free;   // mirrors free_chunks.size() for lock-free readers
+  std::mutex mutex;
+  std::vector<Chunk*> free_chunks;
+  std::vector<std::unique_ptr<Chunk[]>> slabs;
+};
+
+/** Small per-thread front for the ChunkPool. Must only be used by a single thread. */
+class ChunkCache {
+public:
+  static constexpr u32 kCapacity = 2 * ChunkPool::kBatchSize;
+
+  ChunkCache(ChunkPool& pool) : pool(pool), num_cached(0) {}
+  ~ChunkCache() { Flush(); }
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+
+  // Returns nullptr if the pool has hit its memory cap and no chunk is free.
+  inline Chunk* Allocate() {
+    if (num_cached == 0) {
+      num_cached = pool.AllocateBatch(cached, ChunkPool::kBatchSize);
+      if (num_cached == 0) return nullptr;
+    }
+    return cached[--num_cached];
+  }
+
+  inline void Release(Chunk* chunk) {
+    // Keep at most kCapacity chunks so an idle thread doesn't hold memory others need.
+    if (num_cached == kCapacity) {
+      num_cached -= ChunkPool::kBatchSize;
+      pool.ReleaseBatch(&cached[num_cached], ChunkPool::kBatchSize);
+    }
+    cached[num_cached++] = chunk;
+  }
+
+  // Hands every cached chunk back to the pool.
+  inline void Flush() {
+    pool.ReleaseBatch(cached, num_cached);
+    num_cached = 0;
+  }
+
+private:
+  ChunkPool& pool;
+  u32 num_cached;
+  Chunk* cached[kCapacity];
+};
+
+}   // namespace Monitor
+
+#endif
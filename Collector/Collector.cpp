@@ -1,35 +1,200 @@
 #include "Collector.h"
 
+#include <chrono>
+#include <cstdio>
+
 
 namespace Monitor {
-Collector::Collector(SharedMemory& shm, TraceId* trace_ids, int num_traces) :
-  shm(shm), num_traces(num_traces), stopped(false), cursor(0) {
-  for (int i = 0; i < num_traces; ++i) this->trace_ids[i] = trace_ids[i];
-  for (int i = 0; i < kMaxChunksInMem; ++i) available[i] = false;
+static u64 NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Collector::Collector(SharedMemory& shm, ChunkPool& pool, TraceId* trace_ids, int num_traces,
+                     u32 flush_latency_us, u32 compress_watermark, const char* spill_dir) :
+  shm(shm), num_traces(num_traces), flush_latency_us(flush_latency_us), compress_watermark(compress_watermark),
+  stopped(false), done(false), producer_cache(pool), consumer_cache(pool), pack(nullptr), pack_used(0),
+  held_pack(nullptr), scratch(new Chunk()), spill_failed(false), staged(false), head(0), tail(0) {
+  for (int i = 0; i < num_traces; ++i) {
+    this->trace_ids[i] = trace_ids[i];
+    pending_since[i] = 0;
+  }
+  if (spill_dir != nullptr) {
+    spill.reset(new SpillFile(spill_dir));
+    staging.reset(new Chunk());
+    if (!spill->IsOpen()) spill.reset();
+  }
+}
+
+Collector::~Collector() {
+  ReleaseHeldPack();
 }
 
 void Collector::Run() {
-  int trace_idx = 0, chunk_idx = 0;
+  int trace_idx = 0;
+  Chunk* chunk = nullptr;
   while (!stopped) {
-    bool success = shm.MaybeConsumeChunk(trace_ids[trace_idx], &chunks[chunk_idx]);
-    trace_idx = (trace_idx + 1) % kTracesPerWorker;
-    if (!success) return;
-    available[chunk_idx] = true;
-    chunk_idx = (chunk_idx + 1) % kMaxChunksInMem;
+    Unspill(chunk);
+
+    // Either the pool is at its memory cap or our queue is full, and we can't spill. Cooldown
+    // until the ingestor releases some.
+    Chunk* dest = NextDestination(chunk);
+    if (dest == nullptr) continue;
+
+    int i = trace_idx;
+    TraceId trace_id = trace_ids[i];
+    trace_idx = (trace_idx + 1) % num_traces;
+    if (!shm.IsOpened(trace_id)) continue;
 
-    // We have consumed kMaxChunksInMem number of chunks. Cooldown.
-    if (chunk_idx == 0) while (!available[kMaxChunksInMem-1]);
+    if (shm.MaybeConsumeChunk(trace_id, dest)) {
+      Emit(dest, chunk);
+      pending_since[i] = 0;
+      continue;
+    }
+
+    // The chunk isn't full yet. Deliver what has been written once it has waited for long enough,
+    // so that events from quiet threads don't sit in the buffer indefinitely.
+    if (shm.NumPending(trace_id) == 0) continue;
+    u64 now = NowUs();
+    if (pending_since[i] == 0) pending_since[i] = now;
+    if (now - pending_since[i] < flush_latency_us) continue;
+    if (shm.ConsumePartialChunk(trace_id, dest)) Emit(dest, chunk);
+    pending_since[i] = 0;
   }
 
+  Drain();
+  if (chunk != nullptr) producer_cache.Release(chunk);
+  // Traces are closed by the Monitor once every thread reading them has finished.
+  done.store(true, std::memory_order_release);
+}
+
+void Collector::Drain() {
+  Chunk* chunk = nullptr;
   for (int i = 0; i < num_traces; ++i) {
-    shm.Close(trace_ids[i]);
+    TraceId trace_id = trace_ids[i];
+    if (!shm.IsOpened(trace_id)) continue;
+    while (true) {
+      // The ingestor keeps running until we are done, so it will release chunks eventually.
+      Chunk* dest;
+      while ((dest = NextDestination(chunk)) == nullptr) Unspill(chunk);
+
+      if (!shm.MaybeConsumeChunk(trace_id, dest, 0) && !shm.ConsumePartialChunk(trace_id, dest)) break;
+      Emit(dest, chunk);
+    }
+  }
+  while (HasSpilled() || staged) Unspill(chunk);
+  if (chunk != nullptr) producer_cache.Release(chunk);
+}
+
+Chunk* Collector::NextDestination(Chunk*& chunk) {
+  if (chunk == nullptr) chunk = producer_cache.Allocate();
+  if (staged) return nullptr;
+  if (!HasSpilled() && chunk != nullptr && !IsFull()) return chunk;
+  if (spill != nullptr && !spill_failed && spill->HasRoom()) return staging.get();
+  return nullptr;
+}
+
+void Collector::Emit(Chunk* dest, Chunk*& chunk) {
+  if (dest == staging.get()) {
+    if (!spill->Write(*dest)) {
+      // The chunk has already left the ring, so it must still be queued, after whatever was
+      // spilled before it. Stop spilling: from now on the program blocks on a full queue.
+      fprintf(stderr, "[!] Spilling failed, falling back to blocking the program\n");
+      spill_failed = true;
+      staged = true;
+    }
+    return;
   }
+  Deliver(chunk);
+  chunk = nullptr;
+}
+
+void Collector::Unspill(Chunk*& chunk) {
+  if (!HasSpilled() && !staged) return;
+  if (chunk == nullptr) chunk = producer_cache.Allocate();
+  if (chunk == nullptr || IsFull()) return;
+  if (HasSpilled()) {
+    if (!spill->Read(chunk)) return;
+  } else {
+    *chunk = *staging;
+    staged = false;
+  }
+  Deliver(chunk);
+  chunk = nullptr;
+}
+
+void Collector::Deliver(Chunk* chunk) {
+  if (compress_watermark != 0 && QueueSize() >= compress_watermark && TryCompress(chunk)) {
+    producer_cache.Release(chunk);
+    return;
+  }
+  // The ingestor lets go of the current pack once it sees a raw chunk after it.
+  pack = nullptr;
+  Push(chunk, kRaw);
+}
+
+bool Collector::TryCompress(Chunk* chunk) {
+  // Records are kept 8-byte aligned within the pack.
+  pack_used = (pack_used + 7) & ~7u;
+  if (pack != nullptr && pack_used < sizeof(Chunk)) {
+    u32 size = ChunkCodec::Compress(*chunk, reinterpret_cast<u8*>(pack) + pack_used, sizeof(Chunk) - pack_used);
+    if (size != 0) {
+      Push(pack, pack_used);
+      pack_used += size;
+      return true;
+    }
+  }
+
+  // Start a new pack, unless that wouldn't save anything.
+  Chunk* new_pack = producer_cache.Allocate();
+  if (new_pack == nullptr) return false;
+  u32 size = ChunkCodec::Compress(*chunk, reinterpret_cast<u8*>(new_pack), sizeof(Chunk) / 2);
+  if (size == 0) {
+    producer_cache.Release(new_pack);
+    return false;
+  }
+  pack = new_pack;
+  pack_used = size;
+  Push(pack, 0);
+  return true;
+}
+
+Chunk* Collector::Take() {
+  while (true) {
+    if (Chunk* chunk = TryTake()) return chunk;
+    if (IsFinished()) {
+      ReleaseHeldPack();
+      return nullptr;
+    }
+  }
+}
+
+Chunk* Collector::TryTake() {
+  u32 h = head.load(std::memory_order_relaxed);
+  if (tail.load(std::memory_order_acquire) == h) {
+    // Nothing to do, so give back what we've cached: with a small pool, the collector may be
+    // waiting for exactly those chunks. The held pack stays, the collector may still append to it.
+    consumer_cache.Flush();
+    return nullptr;
+  }
+  Slot slot = chunks[h & (kMaxChunksInMem - 1)];
+  head.store(h + 1, std::memory_order_release);
+
+  if (slot.chunk != held_pack) ReleaseHeldPack();
+  if (slot.offset == kRaw) return slot.chunk;
+  held_pack = slot.chunk;
+  ChunkCodec::Decompress(reinterpret_cast<const u8*>(slot.chunk) + slot.offset, scratch.get());
+  return scratch.get();
+}
+
+bool Collector::IsFinished() {
+  // Everything has been pushed before `done` is set, so an empty queue after that means we are finished.
+  return done.load(std::memory_order_acquire) &&
+    tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed);
 }
 
-Chunk& Collector::Take() {
-  while (!available[cursor]);
-  cursor = (cursor + 1) % kMaxChunksInMem;
-  return chunks[cursor];
+void Collector::Release(Chunk* chunk) {
+  if (chunk != scratch.get()) consumer_cache.Release(chunk);
 }
 
 void Collector::Stop() {
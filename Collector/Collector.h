@@ -2,32 +2,110 @@
 #define MONITOR_COLLECTOR_H
 
 #include <atomic>
+#include <memory>
 #include <vector>
 
 #include "Common/Constants.h"
 #include "Common/Types.h"
 #include "Common/Event.h"
+#include "ChunkCodec.h"
+#include "ChunkPool.h"
+#include "SpillFile.h"
 #include "SharedMemory.h"
 
 
 namespace Monitor {
 class Collector {
 public:
+  // Capacity of the queue of collected chunks. Only pointers are stored here, the chunks
+  // themselves come from the shared ChunkPool.
   static constexpr int kMaxChunksInMem = 0x2000;
-  Collector(SharedMemory& shm, TraceId* trace_ids, int num_traces);
+  static_assert((kMaxChunksInMem & (kMaxChunksInMem - 1)) == 0);
+
+  // Once `compress_watermark` chunks are waiting in the queue, further chunks are compressed
+  // (see ChunkCodec) into shared pack chunks until the ingestor catches up. 0 never compresses.
+  // With a `spill_dir`, chunks that find the pool or the queue full are spilled to a file there
+  // instead of leaving the producer blocked, and queued again in order once there is room.
+  Collector(SharedMemory& shm, ChunkPool& pool, TraceId* trace_ids, int num_traces,
+            u32 flush_latency_us = kDefaultFlushLatencyUs, u32 compress_watermark = kDefaultCompressWatermark,
+            const char* spill_dir = nullptr);
+  ~Collector();
   void Run();
-  Chunk& Take();
+  // Blocks until a chunk is available. Returns nullptr once the collector has stopped and
+  // everything it collected has been taken.
+  // A chunk stays valid until it is released. Transient ones must be released before taking the next.
+  Chunk* Take();
+  // Returns nullptr if no chunk is available right now.
+  Chunk* TryTake();
+  // Whether the collector has stopped and every chunk it collected has been taken.
+  bool IsFinished();
+  void Release(Chunk* chunk);
+  // Whether `chunk` is only a decompressed view of a queued chunk, reused by the next take.
+  bool IsTransient(const Chunk* chunk) const { return chunk == scratch.get(); }
+  // Makes `Run` drain all remaining data, including partially filled chunks, and return.
   void Stop();
 private:
+  // A queued chunk: either `chunk` itself, or a compressed copy at `offset` bytes into the pack `chunk`.
+  struct Slot {
+    Chunk* chunk;
+    u32 offset;
+  };
+  static constexpr u32 kRaw = ~0u;
+
+  void Drain();
+  // Picks where the next chunk is collected into: `chunk`, allocated if needed, when it can be
+  // queued right away, or the staging chunk when it has to be spilled. Returns nullptr if neither
+  // is possible right now.
+  Chunk* NextDestination(Chunk*& chunk);
+  // Queues or spills a chunk collected into `dest`.
+  void Emit(Chunk* dest, Chunk*& chunk);
+  // Queues the oldest spilled chunk, or else the staged one, if there's room.
+  void Unspill(Chunk*& chunk);
+  // Once anything is spilled, newer chunks must be spilled too so every trace stays in order.
+  inline bool HasSpilled() { return spill != nullptr && !spill->Empty(); }
+  // Queues `chunk`, compressing it if the ingestor is behind.
+  void Deliver(Chunk* chunk);
+  bool TryCompress(Chunk* chunk);
+  inline u32 QueueSize() {
+    return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire);
+  }
+  inline bool IsFull() { return QueueSize() == kMaxChunksInMem; }
+  inline void Push(Chunk* chunk, u32 offset) {
+    u32 t = tail.load(std::memory_order_relaxed);
+    chunks[t & (kMaxChunksInMem - 1)] = { chunk, offset };
+    tail.store(t + 1, std::memory_order_release);
+  }
+  inline void ReleaseHeldPack() {
+    if (held_pack != nullptr) consumer_cache.Release(held_pack);
+    held_pack = nullptr;
+  }
+
   SharedMemory& shm;
-  int cursor;   // only used by a single ingestor when it calls `Take`, so it is data-race-free
   int num_traces;
+  u32 flush_latency_us;
+  u32 compress_watermark;
   std::atomic<bool> stopped;
+  std::atomic<bool> done;
   TraceId trace_ids[kNumTraces];
-  Chunk chunks[kMaxChunksInMem];
-  std::atomic<bool> available[kMaxChunksInMem];
+  u64 pending_since[kNumTraces];   // when unflushed data was first seen for each trace, 0 if none
+  ChunkCache producer_cache;   // only used by the thread calling `Run`
+  ChunkCache consumer_cache;   // only used by the single ingestor, flushed whenever the queue is empty
+  // Pack compressed chunks are being appended to, and how many bytes of it are used. Once the
+  // collector moves on to another pack or queues a raw chunk, it never touches this one again.
+  Chunk* pack;
+  u32 pack_used;
+  // Pack the ingestor is reading from, released once the queue has moved past it.
+  Chunk* held_pack;
+  std::unique_ptr<Chunk> scratch;   // compressed chunks are handed to the ingestor decompressed here
+  std::unique_ptr<SpillFile> spill;   // only with a spill directory
+  std::unique_ptr<Chunk> staging;   // chunks on their way to the spill file
+  bool spill_failed;   // after a write error, never spill again
+  bool staged;   // `staging` holds a chunk that couldn't be spilled, queued before collecting more
+  Slot chunks[kMaxChunksInMem];
+  alignas(kCacheLineSize) std::atomic<u32> head;   // advanced by `Take`
+  alignas(kCacheLineSize) std::atomic<u32> tail;   // advanced by `Run`
 };
 
 }   // namespace Monitor
 
-#endif
\ No newline at end of file
+#endif
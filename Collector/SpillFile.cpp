@@ -0,0 +1,98 @@
+#include "SpillFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+
+namespace Monitor {
+SpillFile::SpillFile(const char* dir, u64 max_bytes) :
+  fd(-1), max_bytes(max_bytes), read_pos(0), write_pos(0), flushed_pos(0),
+  write_buffer(new u8[kBufferSize]), read_buffer(new u8[kBufferSize]), read_buffer_pos(0), read_buffer_len(0) {
+  char file_name[256];
+  snprintf(file_name, sizeof(file_name), "%s/monitor-spill-XXXXXX", dir);
+  fd = mkstemp(file_name);
+  if (fd < 0) {
+    perror(file_name);
+    return;
+  }
+  // Nobody else needs to see it, and it goes away with us even if we crash.
+  unlink(file_name);
+}
+
+SpillFile::~SpillFile() {
+  if (fd >= 0) close(fd);
+}
+
+bool SpillFile::Write(const Chunk& chunk) {
+  if (!IsOpen() || !HasRoom()) return false;
+  if (write_pos - flushed_pos + kMaxRecordSize > kBufferSize && !Flush()) return false;
+
+  u32 size = ChunkCodec::Compress(chunk, &write_buffer[write_pos - flushed_pos], kMaxRecordSize);
+  write_pos += size;
+  return size != 0;
+}
+
+bool SpillFile::Flush() {
+  // Records the reader has already taken out of the buffer don't need to hit the disk.
+  u64 start = std::max(flushed_pos, read_pos);
+  const u8* data = &write_buffer[start - flushed_pos];
+  u64 remaining = write_pos - start;
+  u64 offset = start;
+  while (remaining > 0) {
+    ssize_t written = pwrite(fd, data, remaining, offset);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror("spill write");
+      return false;
+    }
+    data += written;
+    offset += written;
+    remaining -= written;
+  }
+  flushed_pos = write_pos;
+  return true;
+}
+
+bool SpillFile::Read(Chunk* out) {
+  if (Empty()) return false;
+
+  if (read_pos >= flushed_pos) {
+    read_pos += ChunkCodec::Decompress(&write_buffer[read_pos - flushed_pos], out);
+  } else {
+    // Refill unless the whole record is buffered. Records never straddle flushed_pos, since the
+    // write buffer is only flushed whole.
+    if (read_pos < read_buffer_pos || read_pos + kMaxRecordSize > read_buffer_pos + read_buffer_len) {
+      u64 wanted = std::min<u64>(kBufferSize, flushed_pos - read_pos);
+      u64 len = 0;
+      while (len < wanted) {
+        ssize_t n = pread(fd, &read_buffer[len], wanted - len, read_pos + len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          perror("spill read");
+          Reset();
+          return false;
+        }
+        len += n;
+      }
+      read_buffer_pos = read_pos;
+      read_buffer_len = len;
+    }
+    read_pos += ChunkCodec::Decompress(&read_buffer[read_pos - read_buffer_pos], out);
+  }
+
+  // Start over at the beginning of the file once it has been read back entirely.
+  if (Empty()) Reset();
+  return true;
+}
+
+void SpillFile::Reset() {
+  if (flushed_pos > 0 && ftruncate(fd, 0) < 0) perror("spill truncate");
+  read_pos = write_pos = flushed_pos = 0;
+  read_buffer_pos = read_buffer_len = 0;
+}
+
+}   // namespace Monitor
@@ -0,0 +1,63 @@
+#ifndef MONITOR_SPILLFILE_H
+#define MONITOR_SPILLFILE_H
+
+#include <memory>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+#include "ChunkCodec.h"
+
+
+namespace Monitor {
+
+/** FIFO of chunks in an unlinked file, for a collector whose ingestor has fallen so far behind
+ *  that memory runs out. Chunks are compressed with ChunkCodec and appended through a large
+ *  buffer, so the disk only sees big sequential writes, which the page cache completes in the
+ *  background. Must only be used by a single thread.
+ */
+class SpillFile {
+public:
+  static constexpr u32 kBufferSize = 1 << 20;
+  // Largest record ChunkCodec can produce: a tag byte and up to 8 delta bytes per word.
+  static constexpr u32 kMaxRecordSize = sizeof(ChunkCodec::Header) + 9 * Chunk::kChunkNumEvents;
+
+  // Creates the file in `dir`. Check `IsOpen` for failure.
+  SpillFile(const char* dir, u64 max_bytes = kDefaultMaxSpillBytes);
+  ~SpillFile();
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  bool IsOpen() const { return fd >= 0; }
+  bool Empty() const { return read_pos == write_pos; }
+  // Whether any chunk is guaranteed to fit under the size cap.
+  bool HasRoom() const { return write_pos + kMaxRecordSize <= max_bytes; }
+  u64 NumBytes() const { return write_pos - read_pos; }
+
+  // Appends `chunk`. Returns false if it could not be written, in which case it is lost.
+  bool Write(const Chunk& chunk);
+  // Moves the oldest chunk into `out`. Returns false if there is none. On a read error everything
+  // spilled is dropped.
+  bool Read(Chunk* out);
+
+private:
+  bool Flush();
+  void Reset();
+
+  int fd;
+  u64 max_bytes;
+  // Offsets into the stream of records. Everything before `flushed_pos` is in the file, the rest
+  // is in write_buffer.
+  u64 read_pos;
+  u64 write_pos;
+  u64 flushed_pos;
+  std::unique_ptr<u8[]> write_buffer;
+  // Holds file contents from `read_buffer_pos` on.
+  std::unique_ptr<u8[]> read_buffer;
+  u64 read_buffer_pos;
+  u32 read_buffer_len;
+};
+
+}   // namespace Monitor
+
+#endif
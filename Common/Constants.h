@@ -2,22 +2,36 @@
 #define MONITOR_CONSTANTS_H
 
 #include "Types.h"
-#include "Event.h"
 
 namespace Monitor {
 
 constexpr u32 kNumTraces = 256;
 constexpr u32 kNumWorkers = 8;
 constexpr u32 kTracesPerWorker = kNumTraces / kNumWorkers;
-static_assert(kNumSlots == kNumWorkers * kTracesPerWorker);
+static_assert(kNumTraces == kNumWorkers * kTracesPerWorker);
 
 constexpr u32 kSpinCount = 0;
 constexpr u32 kBufferNumEvents = 0x1000;
 constexpr u32 kBufferIdxMask = 0xfff;
-constexpr u32 kBufferSize = kBufferNumEvents * sizeof(LoggedEvent);
+constexpr u32 kBufferSize = kBufferNumEvents * sizeof(u64);   // one LoggedEvent per entry
+// Each trace's file holds the event buffer followed by a TraceHeader written by the producer.
+constexpr u32 kTraceHeaderSize = 0x1000;
+constexpr u32 kTraceMappingSize = kBufferSize + kTraceHeaderSize;
 
 constexpr u32 kCacheLineSize = 64;
 
+// Upper bound on memory used by buffered chunks across all collectors.
+constexpr u64 kDefaultChunkPoolBytes = 256ull << 20;
+
+// How long written events may sit in a partially filled chunk before collectors flush it.
+constexpr u32 kDefaultFlushLatencyUs = 1000;
+
+// Chunks waiting in a collector's queue beyond which it compresses new ones.
+constexpr u32 kDefaultCompressWatermark = 256;
+
+// Upper bound on the size of each collector's spill file.
+constexpr u64 kDefaultMaxSpillBytes = 4ull << 30;
+
 }   // namespace Monitor
 
 #endif
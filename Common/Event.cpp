@@ -9,10 +9,6 @@ const char* eventtype_to_string(EventType evt) {
     return "READ";
   case WRITE:
     return "WRITE";
-  case VPTRUPDATE:
-    return "VPTRUPDATE";
-  case VPTRLOAD:
-    return "VPTRLOAD";
   case MEMSET:
     return "MEMSET";
   case MEMCPY:
@@ -31,6 +27,14 @@ const char* eventtype_to_string(EventType evt) {
     return "RETURN";
   case ATEXIT:
     return "ATEXIT";
+  case ACQUIRE:
+    return "ACQUIRE";
+  case RELEASE:
+    return "RELEASE";
+  case IGNOREBEGIN:
+    return "IGNOREBEGIN";
+  case IGNOREEND:
+    return "IGNOREEND";
 
   default:
     return "UNKNOWN";
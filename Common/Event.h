@@ -7,6 +7,7 @@
 #include <optional>
 
 #include <utility>
+#include "Constants.h"
 #include "Types.h"
 
 namespace Monitor {
@@ -50,6 +51,7 @@ typedef union {
     EventType event_type : 8;
   };
 } LoggedEvent;
+static_assert(sizeof(LoggedEvent) == sizeof(u64));
 
 typedef std::atomic<LoggedEvent> AMEvent;
 
@@ -95,7 +97,7 @@ constexpr LoggedEventSig kReleaseSig = { .type=RELEASE, .args=(LoggedEventArgTyp
 constexpr LoggedEventSig kMemsetSig = { .type=MEMSET, .args=(LoggedEventArgType[]){ DEST, SOURCE, COUNT  }};
 constexpr LoggedEventSig kMemcpySig = { .type=MEMCPY, .args=(LoggedEventArgType[]){ DEST, SOURCE, COUNT  }};
 
-int EventNumArgs(EventType evt) {
+inline int EventNumArgs(EventType evt) {
   switch (evt) {
   case CLEAR:
   case ATEXIT:
@@ -133,23 +135,50 @@ public:
   // Only for preallocation
   Chunk() {}
 
-  Chunk(TraceId trace_id, AMEvent* buffer, int idx)
-    : trace_id_(trace_id) {
-    for (int i = 0; i < kChunkNumEvents; ++i)
+  // A chunk may hold fewer than kChunkNumEvents events when it is flushed before the
+  // producer has filled it.
+  Chunk(TraceId trace_id, AMEvent* buffer, int idx, u32 num_events = kChunkNumEvents)
+    : trace_id_(trace_id), num_events_(num_events), cursor_(0) {
+    assert(num_events <= kChunkNumEvents);
+    for (u32 i = 0; i < num_events; ++i)
       events_[i] = buffer[idx + i];
   }
 
+  // Events are to be filled in through MutableData, e.g. when received from another node.
+  Chunk(TraceId trace_id, u32 num_events) : trace_id_(trace_id), num_events_(num_events), cursor_(0) {
+    assert(num_events <= kChunkNumEvents);
+  }
+
   inline std::optional<LoggedEvent> Next() {
-    if (cursor_ >= kChunkNumEvents) return std::nullopt;
+    if (cursor_ >= num_events_) return std::nullopt;
     return std::optional(events_[cursor_++]);
   }
 
-  TraceId GetTraceId() { return trace_id_; }
+  // Raw access for decoders that want to walk the events in a tight loop.
+  const LoggedEvent* Data() const { return events_; }
+  LoggedEvent* MutableData() { return events_; }
+  u32 Size() const { return num_events_; }
+
+  TraceId GetTraceId() const { return trace_id_; }
+
+  // TSC stamps of when the producer started writing this chunk (0 if the runtime doesn't stamp
+  // chunks) and when the monitor copied it out of the shared buffer.
+  void SetTimestamps(u64 produced_tsc, u64 collected_tsc) {
+    produced_tsc_ = produced_tsc;
+    collected_tsc_ = collected_tsc;
+  }
+  u64 GetProducedTsc() const { return produced_tsc_; }
+  u64 GetCollectedTsc() const { return collected_tsc_; }
 
 private:
+  friend class ChunkCodec;
+
   LoggedEvent events_[kChunkNumEvents];
   TraceId trace_id_;
-  int cursor_;
+  u32 num_events_;
+  u32 cursor_;
+  u64 produced_tsc_ = 0;
+  u64 collected_tsc_ = 0;
 };
 
 /** Event classes that are given to the client. They shouldn't need to think about things like
@@ -175,8 +204,15 @@ typedef struct IngestorEvent {
     std::optional<u64> count;
   };
 
-  // TODO: Maybe this shouldn't be exposed to the client
-  // std::optional<u64> lock_counter;
+  // Only set for acquire/release and atomics. Operations on the same lock carry increasing
+  // counters, which is what lets analyses order them across traces.
+  std::optional<u64> lock_counter;
+
+  // Set by the Decoder: the index of the event within its trace, and the producer's stamp of the
+  // chunk the event starts in (0 if the runtime doesn't stamp chunks). The stamp is a lower bound
+  // on when the event was recorded, with the resolution of one chunk.
+  u64 seq = 0;
+  u64 tsc = 0;
 
   // Note: There is a performance cost in using optional. But we'll take that for now. Usability by the client is more important.
   // Principally, we just want to enforce syntactical restrictions for the client to not load the fields when they are not meant to do so.
@@ -187,7 +223,7 @@ typedef struct IngestorEvent {
 // of the caller to make sure the right number of arguments are passed in.
 // Also, ideally we generated this using some metaprogramming from the sigs defined above.
 // Declaring like this is error prone especially when we decide to change the format one day.
-IngestorEvent MakeIngestorEvent(LoggedEvent* event_and_args) {
+inline IngestorEvent MakeIngestorEvent(const LoggedEvent* event_and_args) {
   LoggedEvent event = event_and_args[0];
   EventType type = event.event_type;
   switch (type) {
@@ -195,81 +231,98 @@ IngestorEvent MakeIngestorEvent(LoggedEvent* event_and_args) {
     return { .type = READ,
              .addr = event_and_args[1].raw,
              .read_value = event_and_args[2].raw,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case WRITE:
     return { .type = WRITE,
              .addr = event_and_args[1].raw,
              .read_value = std::nullopt,
-             .write_value = event_and_args[2].raw};
+             .write_value = event_and_args[2].raw,
+             .lock_counter = std::nullopt};
   case MEMSET:
     return { .type = MEMSET,
              .dest = event_and_args[1].raw,
              .source = event_and_args[2].raw,
-             .count = event_and_args[3].raw};
+             .count = event_and_args[3].raw,
+             .lock_counter = std::nullopt};
   case MEMCPY:
     return { .type = MEMCPY,
              .dest = event_and_args[1].raw,
              .source = event_and_args[2].raw,
-             .count = event_and_args[3].raw};
+             .count = event_and_args[3].raw,
+             .lock_counter = std::nullopt};
   case ATOMICLOAD:
     return { .type = ATOMICLOAD,
              .addr = event_and_args[1].raw,
-             .read_value = event_and_args[3].raw};
+             .read_value = event_and_args[3].raw,
+             .write_value = std::nullopt,
+             .lock_counter = event_and_args[2].raw};
   case ATOMICSTORE:
     return { .type = ATOMICSTORE,
              .addr = event_and_args[1].raw,
              .read_value = std::nullopt,
-             .write_value = event_and_args[3].raw};
+             .write_value = event_and_args[3].raw,
+             .lock_counter = event_and_args[2].raw};
   case ATOMICRMW:
     return { .type = ATOMICRMW,
              .addr = event_and_args[1].raw,
              .read_value = event_and_args[3].raw,
-             .write_value = event_and_args[4].raw};
+             .write_value = event_and_args[4].raw,
+             .lock_counter = event_and_args[2].raw};
   case ATOMICCAS:
     return { .type = ATOMICCAS,
              .addr = event_and_args[1].raw,
              .read_value = event_and_args[3].raw,
-             .write_value = event_and_args[4].raw};
+             .write_value = event_and_args[4].raw,
+             .lock_counter = event_and_args[2].raw};
   case ATOMICFENCE:
     return { .type = ATOMICFENCE,
              .addr = std::nullopt,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case RETURN:
     return { .type = RETURN,
              .addr = event_and_args[1].raw,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case ATEXIT:
     return { .type = ATEXIT,
              .addr = std::nullopt,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case CLEAR:
     return { .type = CLEAR,
              .addr = std::nullopt,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case IGNOREBEGIN:
     return { .type = IGNOREBEGIN,
              .addr = std::nullopt,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case IGNOREEND:
     return { .type = IGNOREEND,
              .addr = std::nullopt,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = std::nullopt};
   case ACQUIRE:
     return { .type = ACQUIRE,
              .addr = event_and_args[1].raw,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = event_and_args[2].raw};
   case RELEASE:
     return { .type = RELEASE,
              .addr = event_and_args[1].raw,
              .read_value = std::nullopt,
-             .write_value = std::nullopt};
+             .write_value = std::nullopt,
+             .lock_counter = event_and_args[2].raw};
   default:
     assert(false && "Forgot to implement for some event type.");
  }
@@ -0,0 +1,48 @@
+#ifndef MONITOR_HISTOGRAM_H
+#define MONITOR_HISTOGRAM_H
+
+#include "Types.h"
+
+namespace Monitor {
+
+/** Histogram with power-of-two buckets. Bucket b counts values in [2^(b-1), 2^b), bucket 0 counts zeros. */
+struct Histogram {
+  static constexpr int kNumBuckets = 65;
+
+  u64 buckets[kNumBuckets] = {};
+  u64 count = 0;
+  u64 sum = 0;
+
+  inline void Add(u64 value) {
+    buckets[value ? 64 - __builtin_clzll(value) : 0]++;
+    count++;
+    sum += value;
+  }
+
+  void Merge(const Histogram& other) {
+    for (int i = 0; i < kNumBuckets; ++i) buckets[i] += other.buckets[i];
+    count += other.count;
+    sum += other.sum;
+  }
+
+  double Mean() const { return count ? (double)sum / count : 0; }
+
+  // Upper bound of the bucket holding the p-th quantile, p in [0, 1].
+  u64 Quantile(double p) const {
+    u64 seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+      seen += buckets[i];
+      if (count && seen >= p * count) return BucketUpperBound(i);
+    }
+    return 0;
+  }
+
+  static u64 BucketUpperBound(int bucket) {
+    if (bucket == 0) return 0;
+    return bucket == 64 ? ~0ull : (1ull << bucket) - 1;
+  }
+};
+
+}   // namespace Monitor
+
+#endif
@@ -2,9 +2,11 @@
 
 #include "stdio.h"
 
+namespace Monitor {
 namespace Log {
   void Info(const char* message) {
     printf("[+] %s\n", message);
   }
 
 }   // namespace Log
+}   // namespace Monitor
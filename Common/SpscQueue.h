@@ -0,0 +1,68 @@
+#ifndef MONITOR_SPSCQUEUE_H
+#define MONITOR_SPSCQUEUE_H
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#include "Constants.h"
+#include "Types.h"
+
+namespace Monitor {
+
+/** Bounded single-producer single-consumer ring. Each side keeps a stale copy of the other side's
+ *  index so that it only touches the shared cache line when the ring looks full (or empty).
+ */
+template <typename T, u32 kCapacity>
+class SpscQueue {
+  static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of 2");
+  // Slots are raw storage so that T need not be default constructible, but then they are never destroyed.
+  static_assert(std::is_trivially_destructible_v<T>);
+public:
+  SpscQueue() : head(0), cached_tail(0), tail(0), cached_head(0) {}
+
+  inline bool TryPush(const T& item) {
+    u32 t = tail.load(std::memory_order_relaxed);
+    if (t - cached_head == kCapacity) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (t - cached_head == kCapacity) return false;
+    }
+    new (&items[t & (kCapacity - 1)]) T(item);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the oldest item without removing it, or nullptr if the queue is empty.
+  inline T* Front() {
+    u32 h = head.load(std::memory_order_relaxed);
+    if (h == cached_tail) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h == cached_tail) return nullptr;
+    }
+    return std::launder(reinterpret_cast<T*>(&items[h & (kCapacity - 1)]));
+  }
+
+  // Removes the item returned by the last `Front`.
+  inline void Pop() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Only meaningful to the consumer, or once the producer is known to be finished.
+  inline bool Empty() const {
+    return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+  }
+
+private:
+  // Consumer side
+  alignas(kCacheLineSize) std::atomic<u32> head;
+  u32 cached_tail;
+  // Producer side
+  alignas(kCacheLineSize) std::atomic<u32> tail;
+  u32 cached_head;
+  struct alignas(T) Slot { unsigned char bytes[sizeof(T)]; };
+  alignas(kCacheLineSize) Slot items[kCapacity];
+};
+
+}   // namespace Monitor
+
+#endif
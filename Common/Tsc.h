@@ -0,0 +1,41 @@
+#ifndef MONITOR_TSC_H
+#define MONITOR_TSC_H
+
+#include <chrono>
+#include <thread>
+
+#include "Types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Monitor {
+
+// Cheap timestamp comparable across cores (assuming an invariant TSC). Falls back to the steady
+// clock in nanoseconds elsewhere.
+inline u64 ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Ticks of ReadTsc per nanosecond, measured once against the steady clock.
+inline double TscPerNs() {
+  static const double tsc_per_ns = [] {
+    auto start = std::chrono::steady_clock::now();
+    u64 tsc_start = ReadTsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    u64 tsc_end = ReadTsc();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return (tsc_end - tsc_start) / ns;
+  }();
+  return tsc_per_ns;
+}
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,52 @@
+#include "Controller.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+
+namespace Monitor {
+Controller::Controller(SharedMemory& shm, ChunkPool& pool, u32 interval_us) :
+  shm(shm), pool(pool), interval_us(interval_us), stopped(false) {}
+
+void Controller::Run() {
+  while (!stopped) {
+    Step();
+    usleep(interval_us);
+  }
+}
+
+void Controller::Step() {
+  ControlPage* control = shm.GetControl();
+  if (control == nullptr) return;
+
+  double pool_fill = (double)pool.NumChunksInUse() / pool.MaxChunks();
+  for (TraceId trace_id = 0; trace_id < kNumTraces; ++trace_id) {
+    if (!shm.IsOpened(trace_id)) continue;
+
+    TraceControl& trace = control->traces[trace_id];
+    u64 written = shm.WriteCount(trace_id);
+    u64 read = trace.read_count.load(std::memory_order_acquire);
+    double buffer_fill = written > read ? (double)(written - read) / kBufferNumEvents : 0;
+    double backlog = std::max(buffer_fill, pool_fill);
+
+    u32 sample_rate = trace.sample_rate.load(std::memory_order_relaxed);
+    u32 event_mask = trace.event_mask.load(std::memory_order_relaxed);
+    if (backlog > kHighWatermark) {
+      if (sample_rate < kMaxSampleRate) sample_rate *= 2;
+      else event_mask = kSheddingMask;
+    } else if (backlog < kLowWatermark) {
+      // Undo in the reverse order.
+      if (event_mask != kAllEventsMask) event_mask = kAllEventsMask;
+      else if (sample_rate > 1) sample_rate /= 2;
+    }
+    trace.sample_rate.store(sample_rate, std::memory_order_relaxed);
+    trace.event_mask.store(event_mask, std::memory_order_relaxed);
+  }
+}
+
+void Controller::Stop() {
+  stopped = true;
+}
+
+}   // namespace Monitor
@@ -0,0 +1,44 @@
+#ifndef MONITOR_CONTROLLER_H
+#define MONITOR_CONTROLLER_H
+
+#include <atomic>
+
+#include "Collector/ChunkPool.h"
+#include "Common/Constants.h"
+#include "Common/Types.h"
+#include "SharedMemory.h"
+
+
+namespace Monitor {
+
+/** Periodically adjusts the sampling rate and event mask of each trace on the control page based
+ *  on how far behind the monitor is. Under a burst the program records fewer plain reads and
+ *  writes instead of blocking on a full buffer, and full recording resumes once the backlog has
+ *  been worked off. Synchronization events are always recorded.
+ */
+class Controller {
+public:
+  static constexpr u32 kMaxSampleRate = 1024;
+  // Backlog is the larger of how full a trace's buffer is and how much of the chunk pool is in use.
+  static constexpr double kHighWatermark = 0.75;
+  static constexpr double kLowWatermark = 0.25;
+  // Recorded at kMaxSampleRate if that still isn't enough. Plain reads are the most frequent
+  // events and the least important for synchronization.
+  static constexpr u32 kSheddingMask = ~(1u << READ);
+  static_assert((~kSheddingMask & ~kSampledEventsMask) == 0, "only sampled events may be shed");
+
+  Controller(SharedMemory& shm, ChunkPool& pool, u32 interval_us);
+  void Run();
+  void Stop();
+private:
+  void Step();
+
+  SharedMemory& shm;
+  ChunkPool& pool;
+  u32 interval_us;
+  std::atomic<bool> stopped;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,38 @@
+#include "LatencyStats.h"
+
+#include "Common/Tsc.h"
+
+
+namespace Monitor {
+
+static void PrintRow(FILE* out, const char* name, const Histogram& ring, const Histogram& queue,
+                     double tsc_per_us) {
+  auto us = [tsc_per_us](double ticks) { return ticks / tsc_per_us; };
+  fprintf(out, "%-8s %10lu", name, queue.count);
+  if (ring.count) {
+    fprintf(out, " %10.1f %10.1f %10.1f", us(ring.Mean()), us(ring.Quantile(0.5)), us(ring.Quantile(0.99)));
+  } else {
+    fprintf(out, " %10s %10s %10s", "-", "-", "-");
+  }
+  fprintf(out, " %10.1f %10.1f %10.1f\n", us(queue.Mean()), us(queue.Quantile(0.5)), us(queue.Quantile(0.99)));
+}
+
+void LatencyStats::Report(FILE* out) const {
+  double tsc_per_us = TscPerNs() * 1000;
+  Histogram total_ring, total_queue;
+
+  // Quantiles are bucket upper bounds, so they overestimate by up to 2x.
+  fprintf(out, "%-8s %10s %10s %10s %10s %10s %10s %10s\n", "trace", "chunks",
+          "ring_avg", "ring_p50", "ring_p99", "queue_avg", "queue_p50", "queue_p99");
+  for (u32 i = 0; i < kNumTraces; ++i) {
+    if (queue[i].count == 0) continue;
+    char name[16];
+    snprintf(name, sizeof(name), "%u", i);
+    PrintRow(out, name, ring[i], queue[i], tsc_per_us);
+    total_ring.Merge(ring[i]);
+    total_queue.Merge(queue[i]);
+  }
+  PrintRow(out, "all", total_ring, total_queue, tsc_per_us);
+}
+
+}   // namespace Monitor
@@ -0,0 +1,46 @@
+#ifndef MONITOR_LATENCY_STATS_H
+#define MONITOR_LATENCY_STATS_H
+
+#include <cstdio>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Histogram.h"
+#include "Common/Types.h"
+
+namespace Monitor {
+
+/** Per-trace latencies of chunks on their way to the ingestors, in TSC ticks:
+ *  ring residency from the producer starting a chunk to the collector copying it out, and queue
+ *  residency from there to an ingestor taking it. Each ingestor thread fills its own.
+ */
+class LatencyStats {
+public:
+  // Called by the ingestor thread when it takes `chunk`.
+  inline void Record(const Chunk& chunk, u64 now_tsc) {
+    TraceId trace_id = chunk.GetTraceId();
+    u64 produced = chunk.GetProducedTsc();
+    u64 collected = chunk.GetCollectedTsc();
+    // Chunks of runtimes that don't stamp them only tell us about the queue.
+    if (produced != 0 && produced <= collected) ring[trace_id].Add(collected - produced);
+    queue[trace_id].Add(now_tsc >= collected ? now_tsc - collected : 0);
+  }
+
+  void Merge(const LatencyStats& other) {
+    for (u32 i = 0; i < kNumTraces; ++i) {
+      ring[i].Merge(other.ring[i]);
+      queue[i].Merge(other.queue[i]);
+    }
+  }
+
+  // Prints quantiles in microseconds for every trace that delivered chunks, then for all of them.
+  void Report(FILE* out) const;
+
+private:
+  Histogram ring[kNumTraces];
+  Histogram queue[kNumTraces];
+};
+
+}   // namespace Monitor
+
+#endif
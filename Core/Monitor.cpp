@@ -1,114 +1,241 @@
 #include "Monitor.h"
 #include "Common/Event.h"
 
+#include <chrono>
 #include <future>
 #include <stdlib.h>
 #include <thread>
 
+#include <poll.h>
+#include <unistd.h>
+
+#include "Transport/ChunkSender.h"
+
 namespace Monitor {
-Monitor::Monitor(int pid) : stopped(false), num_events(0), shm(new SharedMemory(pid)) {
-  TraceId trace_ids[kTracesPerWorker];
-  collectors.reserve(kNumWorkers);
-  for (int i = 0; i < kNumWorkers; ++i) {
-    for (int j = 0; j < kTracesPerWorker; ++j) {
-      trace_ids[j] = j * kTracesPerWorker + i;
+Monitor::Monitor(int pid, const MonitorOptions& options) :
+  shm(nullptr), chunk_pool(options.max_chunk_bytes), forward_to(options.forward_to), listen_fd(-1),
+  stopped(false), num_events(0) {
+  if (options.listen_port != 0) {
+    // Bind right away, so that a forwarding monitor can connect as soon as we are constructed.
+    listen_fd = ChunkStream::Listen(options.listen_port);
+  } else {
+    shm = new SharedMemory(pid);
+    TraceId trace_ids[kTracesPerWorker];
+    collectors.reserve(kNumWorkers);
+    for (u32 i = 0; i < kNumWorkers; ++i) {
+      for (u32 j = 0; j < kTracesPerWorker; ++j) {
+        trace_ids[j] = j * kNumWorkers + i;
+      }
+      collectors.emplace_back(new Collector(*shm, chunk_pool, trace_ids, kTracesPerWorker,
+                                           options.flush_latency_us, options.compress_watermark, options.spill_dir));
     }
-    collectors.emplace_back(shm, trace_ids, kTracesPerWorker);
+    if (options.control_interval_us > 0)
+      controller.reset(new Controller(*shm, chunk_pool, options.control_interval_us));
   }
 
   ingestors.reserve(kNumWorkers);
-  for (int i = 0; i < kNumWorkers; ++i) {
-    ingestors.emplace_back();
+  for (u32 i = 0; i < kNumWorkers; ++i) {
+    if (options.make_ingestor) ingestors.push_back(options.make_ingestor(i));
+    else ingestors.emplace_back(new Ingestor());
   }
+
+  decoders.resize(kNumWorkers);
+  if (options.shard_by_address) router.reset(new Router());
+  if (options.report_latency) latencies.resize(kNumWorkers);
 }
 
 Monitor::~Monitor() {
+  if (listen_fd >= 0) close(listen_fd);
   delete shm;
 }
 
 void Monitor::Start() {
-  std::thread collector_threads[kNumWorkers];
-  std::thread ingestor_threads[kNumWorkers];
+  if (shm == nullptr) {
+    Receive();
+  } else {
+    std::thread collector_threads[kNumWorkers];
+
+    for (TraceId trace_id = 0; trace_id < kNumTraces; ++trace_id) shm->Open(trace_id);
+    shm->OpenControl();
+    // Tell the program it can start.
+    if (shm->IsOpened(0)) shm->Ready();
+
+    std::thread controller_thread;
+    if (controller) controller_thread = std::thread([this] { controller->Run(); });
+
+     // Spawn threads
+    for (u32 i = 0; i < kNumWorkers; i++) {
+      collector_threads[i] = std::thread([this, i] { collectors[i]->Run(); });
+    }
+
+    if (forward_to != nullptr) {
+      std::thread forward_threads[kNumWorkers];
+      for (u32 i = 0; i < kNumWorkers; i++) forward_threads[i] = std::thread([this, i] { Forward(i); });
+      for (u32 i = 0; i < kNumWorkers; i++) forward_threads[i].join();
+    } else {
+      RunIngestors(collectors);
+    }
+
+    // Wait for all threads to complete
+    for (u32 i = 0; i < kNumWorkers; i++) {
+      collector_threads[i].join();
+    }
+    if (controller) {
+      controller->Stop();
+      controller_thread.join();
+    }
 
-   // Spawn threads
-  for (int i = 0; i < kNumWorkers; i++) {
-    collector_threads[i] = std::thread([this, i] { collectors[i].Run(); });
+    for (TraceId trace_id = 0; trace_id < kNumTraces; ++trace_id) shm->Close(trace_id);
   }
 
-  for (int ingestor_i = 0; ingestor_i < kNumWorkers; ingestor_i++) {
-    ingestor_threads[ingestor_i] = std::thread([this, ingestor_i] {
-      Ingestor& ingestor = ingestors[ingestor_i];
-      // May be excessive memory allocation but allows for random access.
-      // Cache the event and its args. kEventMaxArgs number of entries mean
-      // the event itself + (kEventMaxArgs-1) args. This is enough, because if
-      // kEventMaxArgs are seen, the event would have had enough args to proceed with handling.
-      LoggedEvent cached_events[kNumTraces][kEventMaxArgs];
-      int has_cached[kNumTraces];
-      for (int i = 0; i < kNumTraces; ++i) has_cached[i] = 0;
-      while (!stopped) {
-        Chunk& chunk = collectors[ingestor_i].Take();
-        TraceId trace_id = chunk.GetTraceId();
-        // Need to design it such that the chunk boundary is transparent to the ingestor.
-        // First, check the number of args for the event. Then, consume that amount.
-        // If the end of the chunk is met. Save these events, and move on to the next chunk.
-        // When we see a chunk for the same trace id, restore those events and continue.
-
-        // Continue taking args for the last event seen in the previous chunk, if any.
-        if (int num_cached = has_cached[trace_id] > 0) {
-          LoggedEvent event = cached_events[trace_id][0];
-          int expected_num_args = EventNumArgs(event.event_type);
-          int remaining_num_args = expected_num_args - (num_cached - 1);
-          for (int arg_i = 0; arg_i < remaining_num_args; ++arg_i) {
-            // We are at the start of a new chunk. There must necessarily be enough events.
-            auto arg = chunk.Next().value();
-            cached_events[trace_id][num_cached + arg_i] = arg;
-          }
-          has_cached[trace_id] = 0;
-          IngestorEvent ingestor_event = MakeIngestorEvent(cached_events[trace_id]);
-          ingestor.handle_event(trace_id, ingestor_event);
-        }
-
-        // Handle all events in the chunk
-        while (true) {
-          auto maybe_event = chunk.Next();
-          if (maybe_event.has_value()) {
-            LoggedEvent& event = maybe_event.value();
-            int num_args = EventNumArgs(event.event_type);
-            int should_break = false;
-
-            // Collect the args for this event.
-            for (int arg_i = 0; arg_i < num_args; ++arg_i) {
-              auto maybe_arg = chunk.Next();
-              if (maybe_arg.has_value()) cached_events[trace_id][arg_i+1] = maybe_arg.value();
-              else {
-                has_cached[trace_id] = arg_i;
-                should_break = true;
-                break;
-              }
-            }
-            if(should_break) break;
-
-            // Handle the event.
-            has_cached[trace_id] = 0;
-            IngestorEvent ingestor_event = MakeIngestorEvent(cached_events[trace_id]);
-            ingestor.handle_event(trace_id, ingestor_event);
-          }
-          else break;
-        }
-      }
+  if (!latencies.empty()) {
+    for (u32 i = 1; i < kNumWorkers; ++i) latencies[0].Merge(latencies[i]);
+    latencies[0].Report(stderr);
+  }
+
+  // TODO: Resolve promises to tally number of events processed
+}
+
+template <typename Source>
+void Monitor::RunIngestors(std::vector<std::unique_ptr<Source>>& sources) {
+  std::thread ingestor_threads[kNumWorkers];
+  for (u32 ingestor_i = 0; ingestor_i < kNumWorkers; ingestor_i++) {
+    ingestor_threads[ingestor_i] = std::thread([this, &sources, ingestor_i] {
+      if (router) IngestSharded(*sources[ingestor_i], ingestor_i);
+      else Ingest(*sources[ingestor_i], ingestor_i);
       // TODO: Create a promise for returning the number of events processed
     });
   }
+  for (u32 i = 0; i < kNumWorkers; i++) {
+    ingestor_threads[i].join();
+  }
+}
+
+template <typename Source>
+void Monitor::Ingest(Source& source, int ingestor_i) {
+  Ingestor& ingestor = *ingestors[ingestor_i];
+  Decoder& decoder = decoders[ingestor_i];
+  auto handle = [&ingestor](TraceId trace_id, IngestorEvent& event) {
+    ingestor.handle_event(trace_id, event);
+  };
 
-  // Wait for all threads to complete
-  for (int i = 0; i < kNumWorkers; i++) {
-    collector_threads[i].join();
+  // The decoder hides chunk boundaries: an event whose args spill over into the
+  // next chunk of its trace is completed when that chunk is fed.
+  // Keep going after a stop until the collector has handed over everything it drained.
+  while (Chunk* chunk = source.Take()) {
+    RecordLatency(ingestor_i, *chunk);
+    decoder.Feed(*chunk, handle);
+    source.Release(chunk);
+    if (decoder.HasProgramEnded()) ProgramEnded(ingestor_i);
   }
-  for (int i = 0; i < kNumWorkers; i++) {
-    ingestor_threads[i].join();
+  ingestor.Finish();
+}
+
+template <typename Source>
+void Monitor::IngestSharded(Source& source, int ingestor_i) {
+  Ingestor& ingestor = *ingestors[ingestor_i];
+  Decoder& decoder = decoders[ingestor_i];
+  auto handle = [&ingestor](TraceId trace_id, IngestorEvent& event) {
+    ingestor.handle_event(trace_id, event);
+  };
+  auto route = [this, ingestor_i, &handle](TraceId trace_id, IngestorEvent& event) {
+    router->Route(ingestor_i, trace_id, event, handle);
+  };
+
+  // Never block on our own collector: other ingestors may be waiting for us to drain their events.
+  while (true) {
+    if (Chunk* chunk = source.TryTake()) {
+      RecordLatency(ingestor_i, *chunk);
+      decoder.Feed(*chunk, route);
+      source.Release(chunk);
+      if (decoder.HasProgramEnded()) ProgramEnded(ingestor_i);
+    } else if (source.IsFinished()) {
+      break;
+    }
+    router->Poll(ingestor_i, handle);
   }
 
-  // TODO: Resolve promises to tally number of events processed
+  router->Finish(ingestor_i);
+  while (!router->IsDrained(ingestor_i)) router->Poll(ingestor_i, handle);
+  ingestor.Finish();
+}
+
+void Monitor::Forward(int ingestor_i) {
+  Collector& collector = *collectors[ingestor_i];
+  ChunkSender sender(forward_to, ingestor_i, collector);
+  if (!sender.IsConnected() && !stopped) Stop();
+
+  // Batch up whatever is queued, but don't hold chunks back waiting for more.
+  while (true) {
+    if (Chunk* chunk = collector.TryTake()) {
+      sender.Send(chunk);
+      continue;
+    }
+    sender.Flush();
+    if (collector.IsFinished()) break;
+    if (sender.HasProgramEnded() && !stopped) Stop();
+  }
+  sender.Finish();
+}
+
+void Monitor::Receive() {
+  if (listen_fd < 0) return;
+
+  // Wait for every ingestor thread of the forwarding monitor to connect. They all do so right away,
+  // so once one has, the others get kConnectTimeoutMs.
+  receivers.resize(kNumWorkers);
+  u32 num_connected = 0;
+  auto deadline = std::chrono::steady_clock::time_point::max();
+  while (num_connected < kNumWorkers && !stopped) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      fprintf(stderr, "[!] Only %u of %u streams connected, giving up\n", num_connected, kNumWorkers);
+      break;
+    }
+    pollfd poll_fd = { listen_fd, POLLIN, 0 };
+    if (poll(&poll_fd, 1, 100) <= 0) continue;
+    ChunkStream::Hello hello;
+    int fd = ChunkReceiver::Accept(listen_fd, &hello);
+    if (fd < 0) continue;
+    if (receivers[hello.stream_i] != nullptr) {
+      fprintf(stderr, "[!] Stream %u is already connected\n", hello.stream_i);
+      close(fd);
+      continue;
+    }
+    receivers[hello.stream_i].reset(new ChunkReceiver(fd, hello, chunk_pool));
+    if (num_connected++ == 0)
+      deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ChunkStream::kConnectTimeoutMs);
+  }
+  if (num_connected < kNumWorkers) {
+    // Hang up on the streams that did connect, so that the sender doesn't wait for us.
+    for (auto& receiver : receivers) {
+      if (receiver != nullptr) receiver->Stop();
+    }
+    return;
+  }
+
+  std::thread receiver_threads[kNumWorkers];
+  for (u32 i = 0; i < kNumWorkers; i++) {
+    receiver_threads[i] = std::thread([this, i] { receivers[i]->Run(); });
+  }
+  RunIngestors(receivers);
+  for (u32 i = 0; i < kNumWorkers; i++) {
+    receiver_threads[i].join();
+  }
+}
+
+void Monitor::ProgramEnded(int ingestor_i) {
+  // When receiving, stopping is up to the forwarding monitor, which still has to drain the
+  // program's buffers.
+  if (!receivers.empty()) receivers[ingestor_i]->NotifyProgramEnded();
+  else if (!stopped) Stop();
+}
+
+void Monitor::Stop() {
+  stopped = true;
+  for (auto& collector : collectors) collector->Stop();
+  for (auto& receiver : receivers) {
+    if (receiver != nullptr) receiver->Stop();
+  }
 }
 
 }   // namespace Monitor
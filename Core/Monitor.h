@@ -2,20 +2,59 @@
 #define MONITOR_MONITOR_H
 
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <pthread.h>
 #include <vector>
 
+#include "Core/Controller.h"
+#include "Core/LatencyStats.h"
 #include "Core/SharedMemory.h"
+#include "Collector/ChunkPool.h"
 #include "Collector/Collector.h"
+#include "Ingestor/Decoder.h"
 #include "Ingestor/Ingestor.h"
+#include "Ingestor/Router.h"
+#include "Transport/ChunkReceiver.h"
 
 
 namespace Monitor {
+struct MonitorOptions {
+  // Upper bound on memory used by buffered chunks.
+  size_t max_chunk_bytes = kDefaultChunkPoolBytes;
+  // How long written events may wait in a partially filled chunk before being delivered.
+  u32 flush_latency_us = kDefaultFlushLatencyUs;
+  // Queue length from which collectors compress chunks before queueing them, 0 to never compress.
+  u32 compress_watermark = kDefaultCompressWatermark;
+  // Directory collectors spill chunks to when memory runs out, rather than blocking the program.
+  // Unset to never spill.
+  const char* spill_dir = nullptr;
+  // Hand each memory access to the ingestor owning its address shard rather than to the
+  // ingestor that collected its trace. See Router.
+  bool shard_by_address = false;
+  // Creates the analysis run by ingestor thread `ingestor_i`. Events are dropped if unset.
+  std::function<std::unique_ptr<Ingestor>(int ingestor_i)> make_ingestor;
+  // How often sampling rates and event masks on the control page are adapted to the backlog.
+  // 0 keeps recording everything.
+  u32 control_interval_us = 0;
+  // Print per-trace ring and queue residency of chunks to stderr once done. See LatencyStats.
+  bool report_latency = false;
+  // Send collected chunks to the monitor listening at "host:port" instead of ingesting them here.
+  const char* forward_to = nullptr;
+  // Ingest the chunks forwarded by a monitor connecting to this port, instead of attaching to a
+  // program. See ChunkStream.
+  u16 listen_port = 0;
+};
+
 class Monitor {
 public:
-  Monitor(int pid);
+  // `pid` is ignored when listening for a forwarding monitor.
+  Monitor(int pid, const MonitorOptions& options = MonitorOptions());
   ~Monitor();
   void Start();
+  // Drains whatever the program has written so far and makes `Start` return. Only stores to
+  // atomics and shuts down sockets, so it can be called from a SIGINT handler.
+  void Stop();
 private:
   // static constexpr int kNumCollectors = kNumWorkers;
   // static constexpr int kNumIngestors = kNumWorkers;
@@ -25,10 +64,31 @@ private:
   // static_assert(kTracesPerIngestor * kNumIngestors == kNumTraces);
 
   SharedMemory *shm;
-  std::vector<Collector> collectors;
-  std::vector<Ingestor> ingestors;
+  ChunkPool chunk_pool;
+  std::vector<std::unique_ptr<Collector>> collectors;
+  std::vector<std::unique_ptr<Ingestor>> ingestors;
+  std::vector<Decoder> decoders;   // one per ingestor thread
+  std::unique_ptr<Router> router;   // only when sharding by address
+  std::unique_ptr<Controller> controller;   // only when adapting sampling to the backlog
+  std::vector<LatencyStats> latencies;   // one per ingestor thread, only when reporting latency
+  const char* forward_to;
+  int listen_fd;   // only when receiving from a forwarding monitor
+  std::vector<std::unique_ptr<ChunkReceiver>> receivers;   // one per ingestor thread, in place of collectors
   std::atomic_bool stopped;
   void worker(int wid);
+  // Runs the ingestor threads over chunks from `sources`, Collectors or ChunkReceivers.
+  template <typename Source>
+  void RunIngestors(std::vector<std::unique_ptr<Source>>& sources);
+  template <typename Source>
+  void Ingest(Source& source, int ingestor_i);
+  template <typename Source>
+  void IngestSharded(Source& source, int ingestor_i);
+  void Forward(int ingestor_i);
+  void Receive();
+  void ProgramEnded(int ingestor_i);
+  inline void RecordLatency(int ingestor_i, const Chunk& chunk) {
+    if (!latencies.empty()) latencies[ingestor_i].Record(chunk, ReadTsc());
+  }
   std::atomic_uint64_t num_events;
 };
 }   // namespace Monitor
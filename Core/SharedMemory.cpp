@@ -32,7 +32,7 @@ void SharedMemory::Open(TraceId trace_id) {
   }
 
   // Ensure that the file will hold enough space
-  lseek(fd, kBufferSize, SEEK_SET);
+  lseek(fd, kTraceMappingSize, SEEK_SET);
   if (write(fd, "", 1) < 1) {
     // printf("Error writing a single byte to file.\n");
     return;
@@ -41,7 +41,7 @@ void SharedMemory::Open(TraceId trace_id) {
 
   std::atomic<LoggedEvent>* mem = reinterpret_cast<std::atomic<LoggedEvent>*>(mmap(
     NULL,
-    kBufferSize,
+    kTraceMappingSize,
     PROT_READ | PROT_WRITE,
     MAP_SHARED,
     fd,
@@ -51,15 +51,53 @@ void SharedMemory::Open(TraceId trace_id) {
   // printf("[MONITOR] Opened and reading from %s\n", file_name);
   fds[trace_id] = fd;
   mems[trace_id] = mem;
+  headers[trace_id] = reinterpret_cast<TraceHeader*>(reinterpret_cast<char*>(mem) + kBufferSize);
   is_open[trace_id] = true;
 }
 
+void SharedMemory::OpenControl() {
+  char file_name[64];
+  snprintf(file_name, 64, "/tmp/tsan.monitor.%d/control", pid);
+  int fd = open(file_name, O_RDWR | O_CREAT, 0666);
+  if (fd < 0) return;
+
+  if (ftruncate(fd, sizeof(ControlPage)) < 0) {
+    close(fd);
+    return;
+  }
+
+  void* mem = mmap(NULL, sizeof(ControlPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+
+  ControlPage* page = reinterpret_cast<ControlPage*>(mem);
+  for (u32 i = 0; i < kNumTraces; ++i) {
+    page->traces[i].read_count.store(read_counts[i], std::memory_order_relaxed);
+    page->traces[i].sample_rate.store(1, std::memory_order_relaxed);
+    page->traces[i].event_mask.store(kAllEventsMask, std::memory_order_relaxed);
+  }
+  // Producers check the version before trusting anything else on the page.
+  page->version.store(kControlPageVersion, std::memory_order_release);
+
+  control_fd = fd;
+  control = page;
+}
+
 SharedMemory::~SharedMemory() {
   char dir_name[64], file_name[64];
   snprintf(dir_name, 64, "/tmp/tsan.monitor.%d", pid);
 
-  for (int i = 0; i < kNumWorkers * kTracesPerWorker; ++i) {
-    snprintf(file_name, 64, "/tmp/tsan.monitor.%d/%d", pid, i);
+  if (control != nullptr) {
+    munmap(control, sizeof(ControlPage));
+    close(control_fd);
+    snprintf(file_name, 64, "/tmp/tsan.monitor.%d/control", pid);
+    unlink(file_name);
+  }
+
+  for (u32 i = 0; i < kNumTraces; ++i) {
+    snprintf(file_name, 64, "/tmp/tsan.monitor.%d/%u", pid, i);
     unlink(file_name);
   }
 
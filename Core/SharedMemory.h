@@ -7,37 +7,96 @@
 #include <cstdio>
 #include <functional>
 
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "Constants.h"
 #include "Event.h"
+#include "Tsc.h"
 
 
 namespace Monitor {
 
+/** Lives right after the event buffer in each trace's shared file. */
+struct TraceHeader {
+  // Total number of words the producer has written into this trace, stored with release
+  // semantics after the words themselves. Stays 0 if the runtime does not publish it, in
+  // which case only full chunks can be consumed. The monitor's ready word at the start of
+  // trace 0 isn't one of them.
+  alignas(kCacheLineSize) std::atomic<u64> write_count;
+  // TSC of when the producer started writing each chunk of the buffer, stored before the chunk's
+  // first word. Stays 0 if the runtime does not stamp chunks.
+  alignas(kCacheLineSize) std::atomic<u64> chunk_tsc[kBufferNumEvents / Chunk::kChunkNumEvents];
+};
+static_assert(sizeof(TraceHeader) <= kTraceHeaderSize);
+
+/** Per-trace feedback from the monitor to the program, one cache line each so that producers
+ *  of different traces don't share lines.
+ */
+struct TraceControl {
+  // Total number of words the monitor has consumed from this trace, counted like
+  // TraceHeader::write_count, up to the last chunk it has consumed completely and cleared. The
+  // producer may write up to read_count + kBufferNumEvents words instead of probing the buffer
+  // for cleared chunks. Words of a partially flushed chunk aren't counted until the rest of it
+  // is consumed, since its slot can't be reused before then.
+  alignas(kCacheLineSize) std::atomic<u64> read_count;
+  // The producer should record one in every sample_rate plain reads and writes (1 records
+  // everything). Other events are never sampled, see kSampledEventsMask.
+  std::atomic<u32> sample_rate;
+  // Bit `t` set means events of type t (< 32) should be recorded. Only applies to the types in
+  // kSampledEventsMask; every other event is always recorded.
+  std::atomic<u32> event_mask;
+};
+
+/** Shared file `/tmp/tsan.monitor.<pid>/control` that the runtime polls cheaply. Written only by
+ *  the monitor, and initialized before the monitor signals that it is ready.
+ */
+struct ControlPage {
+  std::atomic<u32> version;
+  TraceControl traces[kNumTraces];
+};
+
+// Version 2 limits sampling and masking to plain reads and writes.
+constexpr u32 kControlPageVersion = 2;
+constexpr u32 kAllEventsMask = 0xffffffff;
+// Events the producer may drop. Synchronization (acquire/release, atomics, fences) and everything
+// else is what happens-before and lock-order analyses are built on, so it is always recorded.
+constexpr u32 kSampledEventsMask = (1u << READ) | (1u << WRITE);
+
 class SharedMemory {
 public:
   SharedMemory() = delete;
   SharedMemory(int pid) : pid(pid) {
-    for (int i = 0; i < kTracesPerWorker; ++i) {
+    for (u32 i = 0; i < kNumTraces; ++i) {
       fds[i] = -1;
       idxs[i] = 0;
+      read_counts[i] = 0;
+      chunk_started[i] = false;
+      chunk_stamps[i] = 0;
       is_open[i] = false;
       mems[i] = 0;
+      headers[i] = nullptr;
     }
+    control = nullptr;
+    control_fd = -1;
   }
 
   ~SharedMemory();
 
   void Open(TraceId trace_id);
+  // Creates and initializes the control page. Must be called before `Ready`.
+  void OpenControl();
+  ControlPage* GetControl() { return control; }
   // Avoid using this. Use ConsumeCheck instead.
   inline LoggedEvent Consume(TraceId trace_id) {
     int idx = idxs[trace_id];
     AMEvent* evp = &mems[trace_id][idx];
     idxs[trace_id] = (idx + 1) & kBufferIdxMask;
+    read_counts[trace_id]++;
     return evp->load();
   }
 
+  // Consumes the rest of the current chunk once the producer has moved on to the chunk after next.
   inline bool MaybeConsumeChunk(TraceId trace_id, Chunk* dest, int max_tries=8) {
     assert(is_open[trace_id]);
 
@@ -53,12 +112,34 @@ public:
       tries++;
      }
 
-    // Consume the whole chunk
-    new (dest) Chunk(trace_id, buf, idx);
+    // Consume the whole chunk, or what is left of it after a partial flush.
+    u32 num_events = (chunk_num + 1) * Chunk::kChunkNumEvents - idx;
+    new (dest) Chunk(trace_id, buf, idx, num_events);
+    Stamp(trace_id, idx, dest);
+    Advance(trace_id, num_events);
+    return true;
+  }
+
+  // Number of words written by the producer that haven't been consumed yet. Always 0 for runtimes
+  // that don't publish their write count.
+  inline u64 NumPending(TraceId trace_id) {
+    assert(is_open[trace_id]);
+    u64 written = headers[trace_id]->write_count.load(std::memory_order_acquire);
+    return written > read_counts[trace_id] ? written - read_counts[trace_id] : 0;
+  }
 
-    // Clear just the first entry of the chunk
-    buf[idx].store(kEvClear);
-    idxs[trace_id] = (idx + Chunk::kChunkNumEvents) & kBufferIdxMask;
+  // Consumes whatever the producer has written so far in the current chunk, without waiting for
+  // the chunk to be filled. Used to bound delivery latency and to drain traces at shutdown.
+  inline bool ConsumePartialChunk(TraceId trace_id, Chunk* dest) {
+    u64 pending = NumPending(trace_id);
+    if (pending == 0) return false;
+
+    int idx = idxs[trace_id];
+    u32 chunk_remaining = Chunk::kChunkNumEvents - idx % Chunk::kChunkNumEvents;
+    u32 num_events = pending < chunk_remaining ? pending : chunk_remaining;
+    new (dest) Chunk(trace_id, mems[trace_id], idx, num_events);
+    Stamp(trace_id, idx, dest);
+    Advance(trace_id, num_events);
     return true;
   }
 
@@ -66,24 +147,66 @@ public:
     assert(idxs[0] == 0);
     assert(mems[0] != nullptr);
 
+    // The ready word takes the first slot of trace 0 but isn't counted as read: read counts are
+    // compared against the producer's write count, which doesn't include it.
     mems[0][0].store(kEvMonitorReady);
     idxs[0]++;
   }
   void Close(TraceId trace_id) {
     if (!is_open[trace_id]) return;
+    munmap(mems[trace_id], kTraceMappingSize);
     mems[trace_id] = nullptr;
+    headers[trace_id] = nullptr;
     close(fds[trace_id]);
     fds[trace_id] = 0;
     is_open[trace_id] = false;
   }
   bool IsOpened(TraceId trace_id) { return is_open[trace_id]; }
+  // Number of words the producer reports having written. Safe to call from any thread while the trace is open.
+  u64 WriteCount(TraceId trace_id) { return headers[trace_id]->write_count.load(std::memory_order_acquire); }
 
 private:
+  // Moves the read position forward. The first entry of a chunk is only cleared, and the read
+  // count only published, once the chunk has been consumed completely: both let the producer
+  // reuse the chunk, whose first word would otherwise be cleared under it.
+  inline void Advance(TraceId trace_id, u32 num_events) {
+    int end = idxs[trace_id] + num_events;
+    idxs[trace_id] = end & kBufferIdxMask;
+    read_counts[trace_id] += num_events;
+    if (end % Chunk::kChunkNumEvents == 0) {
+      mems[trace_id][end - Chunk::kChunkNumEvents].store(kEvClear);
+      PublishReadCount(trace_id);
+      chunk_started[trace_id] = false;
+    }
+  }
+
+  // The producer's stamp is read when a chunk is first consumed from and reused for the rest of
+  // it, so that every piece of a partially flushed chunk carries the stamp of the same lap.
+  inline void Stamp(TraceId trace_id, int idx, Chunk* chunk) {
+    if (!chunk_started[trace_id]) {
+      chunk_stamps[trace_id] =
+        headers[trace_id]->chunk_tsc[idx / Chunk::kChunkNumEvents].load(std::memory_order_relaxed);
+      chunk_started[trace_id] = true;
+    }
+    chunk->SetTimestamps(chunk_stamps[trace_id], ReadTsc());
+  }
+
+  inline void PublishReadCount(TraceId trace_id) {
+    if (control != nullptr)
+      control->traces[trace_id].read_count.store(read_counts[trace_id], std::memory_order_release);
+  }
+
   int pid;
   bool is_open[kNumTraces];
   AMEvent* mems[kNumTraces];
   int fds[kNumTraces];
   int idxs[kNumTraces];
+  u64 read_counts[kNumTraces];
+  bool chunk_started[kNumTraces];   // whether part of the current chunk has been consumed
+  u64 chunk_stamps[kNumTraces];   // producer stamp of the current chunk, once started
+  TraceHeader* headers[kNumTraces];
+  ControlPage* control;
+  int control_fd;
 };
 
 }   // namespace Monitor
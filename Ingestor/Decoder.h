@@ -0,0 +1,85 @@
+#ifndef MONITOR_DECODER_H
+#define MONITOR_DECODER_H
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+
+namespace Monitor {
+
+/** Resumable decoder that turns chunks of LoggedEvents into IngestorEvents.
+ *  An event and its args may be split across two chunks of the same trace. The decoder keeps a
+ *  small state machine per trace, so when a chunk ends in the middle of an event it simply
+ *  suspends, and resumes with the remaining args when the next chunk of that trace arrives.
+ *  Chunks of different traces can therefore be fed in any interleaving.
+ */
+class Decoder {
+public:
+  Decoder() : program_ended(false) {
+    for (u32 i = 0; i < kNumTraces; ++i) states[i] = {};
+  }
+
+  // Decode every event in `chunk`, calling `handle(trace_id, ingestor_event)` for each complete one.
+  // Returns the number of events handled.
+  template <typename F>
+  u64 Feed(Chunk& chunk, F&& handle) {
+    TraceId trace_id = chunk.GetTraceId();
+    State& state = states[trace_id];
+    const LoggedEvent* it = chunk.Data();
+    const LoggedEvent* end = it + chunk.Size();
+    u64 num_handled = 0;
+
+    while (it != end) {
+      // Start of a new event. Learn how many args it needs.
+      if (state.num_pending == 0) {
+        if (::Monitor::HasProgramEnded(*it)) {
+          program_ended = true;
+          it++;
+          continue;
+        }
+        state.pending[0] = *it++;
+        state.num_pending = 1;
+        state.tsc = chunk.GetProducedTsc();
+        state.num_missing = EventNumArgs(state.pending[0].event_type);
+      }
+
+      // Take as many of the missing args as this chunk has.
+      while (state.num_missing > 0 && it != end) {
+        state.pending[state.num_pending++] = *it++;
+        state.num_missing--;
+      }
+      if (state.num_missing > 0) break;   // suspend until the next chunk of this trace
+
+      IngestorEvent ingestor_event = MakeIngestorEvent(state.pending);
+      ingestor_event.seq = state.next_seq++;
+      ingestor_event.tsc = state.tsc;
+      handle(trace_id, ingestor_event);
+      state.num_pending = 0;
+      num_handled++;
+    }
+    return num_handled;
+  }
+
+  // Whether trace_id is suspended in the middle of an event.
+  bool IsSuspended(TraceId trace_id) const { return states[trace_id].num_pending != 0; }
+
+  // Whether kEvProgramEnded has been seen in any of the traces fed so far.
+  bool HasProgramEnded() const { return program_ended; }
+
+private:
+  struct State {
+    // The event itself + up to kEventMaxArgs args.
+    LoggedEvent pending[kEventMaxArgs + 1];
+    int num_pending;
+    int num_missing;
+    u64 next_seq;   // of the next event handled
+    u64 tsc;   // stamp of the chunk the pending event started in
+  };
+
+  State states[kNumTraces];
+  bool program_ended;
+};
+
+}   // namespace Monitor
+
+#endif
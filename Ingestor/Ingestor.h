@@ -6,13 +6,17 @@
 
 namespace Monitor {
 
+/** Base class for analyses. Each ingestor is only ever called from its own ingestor thread.
+ *  The default implementation drops every event.
+ */
 class Ingestor {
+protected:
   typedef IngestorEvent Event;
 public:
-  Ingestor(Collector& collector) : collector(collector) {}
-  int handle_event(TraceId, Event&);
-private:
-  Collector &collector;
+  virtual ~Ingestor() {}
+  virtual int handle_event(TraceId, Event&) { return 0; }
+  // Called from the ingestor thread once no more events will be handled.
+  virtual void Finish() {}
 };
 
 }   // namespace Monitor
@@ -0,0 +1,121 @@
+#include "LockProfiler.h"
+
+#include <algorithm>
+
+
+namespace Monitor {
+
+void LockProfile::Merge(u64 addr, u64 num_acquires, const Histogram& hold,
+                        const std::bitset<kNumTraces>& traces, std::vector<LockOp>& ops) {
+  std::lock_guard<std::mutex> lock(mutex);
+  LockStats& stats = locks[addr];
+  stats.num_acquires += num_acquires;
+  stats.hold.Merge(hold);
+  stats.traces |= traces;
+  stats.pending.insert(stats.pending.end(), ops.begin(), ops.end());
+  // Other ingestors may still hold operations older than these, so only fold the older half.
+  if (stats.pending.size() > kMaxPendingOps) Process(stats, stats.pending.size() / 2);
+}
+
+void LockProfile::Process(LockStats& stats, size_t n) {
+  std::sort(stats.pending.begin(), stats.pending.end(),
+            [](const LockOp& a, const LockOp& b) { return a.counter < b.counter; });
+
+  for (size_t i = 0; i < n; ++i) {
+    const LockOp& op = stats.pending[i];
+    if (stats.last.has_value() && op.counter < stats.last->counter) {
+      // Arrived after newer operations had already been folded.
+      stats.num_out_of_order++;
+      continue;
+    }
+    const std::optional<LockOp>& last = stats.last;
+    if (op.is_acquire && last.has_value() && !last->is_acquire && op.trace_id != last->trace_id)
+      stats.num_owner_changes++;
+    stats.last = op;
+  }
+  stats.pending.erase(stats.pending.begin(), stats.pending.begin() + n);
+}
+
+static void PrintHistogram(FILE* out, const char* name, const Histogram& histogram) {
+  fprintf(out, "%s: count=%lu mean=%.1f p50<=%lu p99<=%lu\n", name, histogram.count, histogram.Mean(),
+          histogram.Quantile(0.5), histogram.Quantile(0.99));
+  for (int i = 0; i < Histogram::kNumBuckets; ++i) {
+    if (histogram.buckets[i] == 0) continue;
+    fprintf(out, "  <= %-20lu %lu\n", Histogram::BucketUpperBound(i), histogram.buckets[i]);
+  }
+}
+
+void LockProfile::Report(FILE* out, u32 top_n) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  Histogram hold;
+  u64 num_out_of_order = 0;
+  std::vector<std::pair<u64, LockStats*>> sorted;
+  for (auto& [addr, stats] : locks) {
+    Process(stats, stats.pending.size());
+    hold.Merge(stats.hold);
+    num_out_of_order += stats.num_out_of_order;
+    sorted.emplace_back(addr, &stats);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+    return a.second->num_owner_changes > b.second->num_owner_changes;
+  });
+
+  fprintf(out, "=== Lock profile: %zu locks ===\n", locks.size());
+  PrintHistogram(out, "Hold time (events)", hold);
+  // Without these, owner changes may be missing or counted wrong.
+  if (num_out_of_order != 0)
+    fprintf(out, "[!] %lu lock operations arrived too late to be ordered\n", num_out_of_order);
+
+  fprintf(out, "Locks changing owner most often:\n");
+  for (u32 i = 0; i < sorted.size() && i < top_n; ++i) {
+    auto& [addr, stats] = sorted[i];
+    fprintf(out, "  %#lx: acquires=%lu owner_changes=%lu hold_mean=%.1f hold_p99<=%lu out_of_order=%lu traces=",
+            addr, stats->num_acquires, stats->num_owner_changes, stats->hold.Mean(), stats->hold.Quantile(0.99),
+            stats->num_out_of_order);
+    const char* sep = "";
+    for (u32 trace_id = 0; trace_id < kNumTraces; ++trace_id) {
+      if (!stats->traces[trace_id]) continue;
+      fprintf(out, "%s%u", sep, trace_id);
+      sep = ",";
+    }
+    fprintf(out, "\n");
+  }
+}
+
+LockProfiler::LockProfiler(LockProfile& profile) : profile(profile), num_ops_since_merge(0) {}
+
+int LockProfiler::handle_event(TraceId trace_id, Event& event) {
+  if (event.type != ACQUIRE && event.type != RELEASE) return 0;
+
+  u64 addr = event.addr.value();
+  LocalLock& lock = locks[addr];
+  bool is_acquire = event.type == ACQUIRE;
+  lock.ops.push_back({ event.lock_counter.value_or(0), trace_id, is_acquire });
+
+  auto& held_by_trace = held[trace_id];
+  if (is_acquire) {
+    lock.num_acquires++;
+    lock.traces.set(trace_id);
+    auto [it, inserted] = held_by_trace.try_emplace(addr, HeldLock{ event.seq, 0 });
+    it->second.depth++;
+  } else {
+    auto it = held_by_trace.find(addr);
+    if (it != held_by_trace.end() && --it->second.depth == 0) {
+      lock.hold.Add(event.seq - it->second.since);
+      held_by_trace.erase(it);
+    }
+  }
+
+  if (++num_ops_since_merge >= kMergeEvery) Merge();
+  return 0;
+}
+
+void LockProfiler::Merge() {
+  for (auto& [addr, lock] : locks)
+    profile.Merge(addr, lock.num_acquires, lock.hold, lock.traces, lock.ops);
+  locks.clear();
+  num_ops_since_merge = 0;
+}
+
+}   // namespace Monitor
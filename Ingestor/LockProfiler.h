@@ -0,0 +1,97 @@
+#ifndef MONITOR_LOCKPROFILER_H
+#define MONITOR_LOCKPROFILER_H
+
+#include <bitset>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Histogram.h"
+#include "Common/Types.h"
+#include "Ingestor.h"
+
+namespace Monitor {
+
+struct LockOp {
+  u64 counter;
+  TraceId trace_id;
+  bool is_acquire;
+};
+
+/** Lock statistics merged from the LockProfilers of all ingestors.
+ *  Acquires and releases of a lock are put back in order with their lock counters, which tells
+ *  us when a lock changed owner, i.e. was acquired by another trace than the one releasing it last.
+ *  That is not necessarily contention: events carry no timestamps precise enough to tell whether
+ *  the acquirer had to wait. Operations merged after newer ones had been folded can't be ordered
+ *  anymore, and are only counted.
+ */
+class LockProfile {
+public:
+  // Pending operations kept per lock before the older half is ordered and folded into the stats.
+  static constexpr u32 kMaxPendingOps = 1 << 16;
+
+  void Merge(u64 addr, u64 num_acquires, const Histogram& hold,
+             const std::bitset<kNumTraces>& traces, std::vector<LockOp>& ops);
+  // Prints the top_n locks changing owner most often, plus the overall hold time histogram.
+  void Report(FILE* out, u32 top_n = 10);
+
+private:
+  struct LockStats {
+    u64 num_acquires = 0;
+    u64 num_owner_changes = 0;
+    u64 num_out_of_order = 0;
+    Histogram hold;
+    std::bitset<kNumTraces> traces;
+    std::vector<LockOp> pending;
+    std::optional<LockOp> last;
+  };
+
+  // Orders and folds the oldest `n` pending operations of a lock into its stats.
+  static void Process(LockStats& stats, size_t n);
+
+  std::mutex mutex;
+  std::unordered_map<u64, LockStats> locks;
+};
+
+/** Ingestor reconstructing per-lock acquire/release intervals. Hold times are measured in events
+ *  executed by the holding trace, counted by the Decoder so that they don't depend on which events
+ *  reach this ingestor. Each ingestor keeps its own lock table and merges it into the shared
+ *  LockProfile every kMergeEvery lock operations.
+ */
+class LockProfiler : public Ingestor {
+public:
+  static constexpr u32 kMergeEvery = 1 << 14;
+
+  LockProfiler(LockProfile& profile);
+
+  int handle_event(TraceId trace_id, Event& event) override;
+  void Finish() override { Merge(); }
+
+private:
+  struct HeldLock {
+    u64 since;   // IngestorEvent::seq of the outermost acquire
+    u32 depth;
+  };
+
+  struct LocalLock {
+    u64 num_acquires = 0;
+    Histogram hold;
+    std::bitset<kNumTraces> traces;
+    std::vector<LockOp> ops;
+  };
+
+  void Merge();
+
+  LockProfile& profile;
+  std::unordered_map<u64, HeldLock> held[kNumTraces];
+  std::unordered_map<u64, LocalLock> locks;
+  u32 num_ops_since_merge;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,251 @@
+#include "Printer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace Monitor {
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+static inline char* AppendStr(char* out, const char* s) {
+  while (*s) *out++ = *s++;
+  return out;
+}
+
+static inline char* AppendDec(char* out, u64 v) {
+  char tmp[20];
+  int n = 0;
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n) *out++ = tmp[--n];
+  return out;
+}
+
+static inline char* AppendHex(char* out, u64 v) {
+  *out++ = '0';
+  *out++ = 'x';
+  int num_digits = v ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+  for (int i = num_digits - 1; i >= 0; --i) out[num_digits - 1 - i] = kHexDigits[(v >> (4 * i)) & 0xf];
+  return out + num_digits;
+}
+
+static inline bool IsRangeEvent(EventType type) { return type == MEMSET || type == MEMCPY; }
+
+PrintWriter::PrintWriter(int fd, PrintFormat format) :
+  format(format), dir(nullptr), fd(fd), num_in_flight(0), stopped(false) {
+  for (u32 i = 0; i < kNumTraces; ++i) trace_fds[i] = fd;
+  WriteHeader(fd);
+  thread = std::thread([this] { Run(); });
+}
+
+PrintWriter::PrintWriter(const char* dir, PrintFormat format) :
+  format(format), dir(dir), fd(-1), num_in_flight(0), stopped(false) {
+  for (u32 i = 0; i < kNumTraces; ++i) trace_fds[i] = kNotOpened;
+  thread = std::thread([this] { Run(); });
+}
+
+PrintWriter::~PrintWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  has_pending.notify_one();
+  thread.join();
+
+  for (char* buffer : free_buffers) delete[] buffer;
+  if (IsPerTrace()) {
+    for (u32 i = 0; i < kNumTraces; ++i)
+      if (trace_fds[i] >= 0) close(trace_fds[i]);
+  }
+}
+
+int PrintWriter::FdFor(TraceId trace_id) {
+  if (!IsPerTrace()) return fd;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (trace_fds[trace_id] >= 0) return trace_fds[trace_id];
+  if (trace_fds[trace_id] == kFailed) return -1;
+
+  const char* ext = format == PrintFormat::CSV ? "csv" : format == PrintFormat::JSON ? "jsonl" : "txt";
+  char file_name[256];
+  snprintf(file_name, sizeof(file_name), "%s/%u.%s", dir, trace_id, ext);
+  int trace_fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (trace_fd < 0) {
+    perror(file_name);
+    fprintf(stderr, "[!] Dropping the events of trace %u\n", trace_id);
+    trace_fds[trace_id] = kFailed;
+    return -1;
+  }
+  WriteHeader(trace_fd);
+  trace_fds[trace_id] = trace_fd;
+  return trace_fd;
+}
+
+void PrintWriter::WriteHeader(int fd) {
+  static const char kCsvHeader[] = "trace_id,type,addr,read_value,write_value\n";
+  if (format == PrintFormat::CSV && write(fd, kCsvHeader, sizeof(kCsvHeader) - 1) < 0)
+    perror("write");
+}
+
+char* PrintWriter::GetBuffer() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (free_buffers.empty() && num_in_flight < kMaxInFlight) return new char[BufferSize()];
+  has_free.wait(lock, [this] { return !free_buffers.empty(); });
+  char* buffer = free_buffers.back();
+  free_buffers.pop_back();
+  return buffer;
+}
+
+void PrintWriter::Submit(int fd, char* buffer, u32 len) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back({ fd, buffer, len });
+    num_in_flight++;
+  }
+  has_pending.notify_one();
+}
+
+void PrintWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    has_pending.wait(lock, [this] { return stopped || !pending.empty(); });
+    if (pending.empty()) return;   // stopped and everything has been written
+
+    Pending p = pending.front();
+    pending.pop_front();
+    lock.unlock();
+
+    const char* data = p.buffer;
+    u32 remaining = p.len;
+    while (remaining > 0) {
+      ssize_t written = write(p.fd, data, remaining);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        perror("write");
+        break;
+      }
+      data += written;
+      remaining -= written;
+    }
+
+    lock.lock();
+    free_buffers.push_back(p.buffer);
+    num_in_flight--;
+    has_free.notify_one();
+  }
+}
+
+int Printer::handle_event(TraceId trace_id, Event& event) {
+  Output& output = outputs[writer.IsPerTrace() ? trace_id : 0];
+  if (output.buffer == nullptr) {
+    if (output.dropped) return 0;
+    output.fd = writer.FdFor(trace_id);
+    if (output.fd < 0) {
+      output.dropped = true;
+      return 0;
+    }
+    output.buffer = writer.GetBuffer();
+    output.len = 0;
+  } else if (output.len + kMaxLineLength > writer.BufferSize()) {
+    writer.Submit(output.fd, output.buffer, output.len);
+    output.buffer = writer.GetBuffer();
+    output.len = 0;
+  }
+
+  char* out = output.buffer + output.len;
+  switch (format) {
+  case PrintFormat::TEXT:
+    out = FormatText(out, trace_id, event);
+    break;
+  case PrintFormat::CSV:
+    out = FormatCsv(out, trace_id, event);
+    break;
+  case PrintFormat::JSON:
+    out = FormatJson(out, trace_id, event);
+    break;
+  }
+  output.len = out - output.buffer;
+  return 0;
+}
+
+void Printer::Finish() {
+  for (u32 i = 0; i < kNumTraces; ++i) {
+    Output& output = outputs[i];
+    if (output.buffer == nullptr) continue;
+    writer.Submit(output.fd, output.buffer, output.len);
+    output.buffer = nullptr;
+  }
+}
+
+char* Printer::FormatText(char* out, TraceId trace_id, Event& event) {
+  *out++ = '#';
+  out = AppendDec(out, trace_id);
+  *out++ = ':';
+  *out++ = ' ';
+  out = AppendStr(out, eventtype_to_string(event.type));
+  if (event.addr.has_value()) {
+    *out++ = ' ';
+    out = AppendHex(out, event.addr.value());
+  }
+  if (event.read_value.has_value()) {
+    *out++ = ' ';
+    out = AppendHex(out, event.read_value.value());
+  }
+  if (event.write_value.has_value()) {
+    *out++ = ' ';
+    out = AppendHex(out, event.write_value.value());
+  }
+  *out++ = '\n';
+  return out;
+}
+
+char* Printer::FormatCsv(char* out, TraceId trace_id, Event& event) {
+  out = AppendDec(out, trace_id);
+  *out++ = ',';
+  out = AppendStr(out, eventtype_to_string(event.type));
+  *out++ = ',';
+  if (event.addr.has_value()) out = AppendHex(out, event.addr.value());
+  *out++ = ',';
+  if (event.read_value.has_value()) out = AppendHex(out, event.read_value.value());
+  *out++ = ',';
+  if (event.write_value.has_value()) out = AppendHex(out, event.write_value.value());
+  *out++ = '\n';
+  return out;
+}
+
+char* Printer::FormatJson(char* out, TraceId trace_id, Event& event) {
+  // Values are emitted as hex strings since JSON numbers can't hold every u64 exactly.
+  bool range = IsRangeEvent(event.type);
+  out = AppendStr(out, "{\"trace_id\":");
+  out = AppendDec(out, trace_id);
+  out = AppendStr(out, ",\"type\":\"");
+  out = AppendStr(out, eventtype_to_string(event.type));
+  *out++ = '"';
+  if (event.addr.has_value()) {
+    out = AppendStr(out, range ? ",\"dest\":\"" : ",\"addr\":\"");
+    out = AppendHex(out, event.addr.value());
+    *out++ = '"';
+  }
+  if (event.read_value.has_value()) {
+    out = AppendStr(out, range ? ",\"source\":\"" : ",\"read_value\":\"");
+    out = AppendHex(out, event.read_value.value());
+    *out++ = '"';
+  }
+  if (event.write_value.has_value()) {
+    out = AppendStr(out, range ? ",\"count\":\"" : ",\"write_value\":\"");
+    out = AppendHex(out, event.write_value.value());
+    *out++ = '"';
+  }
+  *out++ = '}';
+  *out++ = '\n';
+  return out;
+}
+
+}   // namespace Monitor
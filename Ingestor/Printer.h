@@ -1,9 +1,118 @@
 #ifndef MONITOR_PRINTER_H
 #define MONITOR_PRINTER_H
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Common/Constants.h"
 #include "Common/Event.h"
+#include "Common/Types.h"
+#include "Ingestor.h"
 
 namespace Monitor {
+
+enum class PrintFormat {
+  TEXT,   // #<trace>: <TYPE> <hex args...>
+  CSV,    // trace_id,type,addr,read_value,write_value (dest,source,count for memset/memcpy)
+  JSON,   // one object per line
+};
+
+/** Writes out buffers filled by Printers from a single background thread, so that ingestor
+ *  threads never block on output. Shared by the Printers of all ingestors.
+ */
+class PrintWriter {
+public:
+  static constexpr u32 kBufferSize = 1 << 20;
+  // Smaller buffers when every trace gets its own, to keep memory in check.
+  static constexpr u32 kPerTraceBufferSize = 1 << 16;
+  // Upper bound on submitted buffers not written yet. Printers wait for the writer once it is reached.
+  static constexpr u32 kMaxInFlight = 64;
+
+  // Writes every trace to `fd`, which is not closed.
+  PrintWriter(int fd, PrintFormat format);
+  // Writes each trace to its own file `<dir>/<trace_id>.<txt|csv|jsonl>`.
+  PrintWriter(const char* dir, PrintFormat format);
+  // Writes everything that has been submitted, then stops the writer thread.
+  ~PrintWriter();
+  PrintWriter(const PrintWriter&) = delete;
+  PrintWriter& operator=(const PrintWriter&) = delete;
+
+  PrintFormat GetFormat() const { return format; }
+  bool IsPerTrace() const { return dir != nullptr; }
+  u32 BufferSize() const { return IsPerTrace() ? kPerTraceBufferSize : kBufferSize; }
+  // Opens the output for trace_id if needed. Returns -1 on failure, which is only reported and
+  // attempted once per trace.
+  int FdFor(TraceId trace_id);
+
+  char* GetBuffer();
+  // Hands `buffer` over to the writer thread. Buffers for the same fd are written in submission order.
+  void Submit(int fd, char* buffer, u32 len);
+
+private:
+  struct Pending {
+    int fd;
+    char* buffer;
+    u32 len;
+  };
+
+  static constexpr int kNotOpened = -1;
+  static constexpr int kFailed = -2;
+
+  void Run();
+  void WriteHeader(int fd);
+
+  PrintFormat format;
+  const char* dir;
+  int fd;
+  int trace_fds[kNumTraces];   // or kNotOpened, or kFailed
+
+  std::mutex mutex;
+  std::condition_variable has_pending;
+  std::condition_variable has_free;
+  std::deque<Pending> pending;
+  std::vector<char*> free_buffers;
+  u32 num_in_flight;
+  bool stopped;
+  std::thread thread;
+};
+
+/** Ingestor that exports every event it sees. Lines are formatted by hand into large per-thread
+ *  buffers, which a PrintWriter writes out in the background.
+ */
+class Printer : public Ingestor {
+public:
+  // Longest line any format can produce.
+  static constexpr u32 kMaxLineLength = 256;
+
+  Printer(PrintWriter& writer) : writer(writer), format(writer.GetFormat()) {
+    for (u32 i = 0; i < kNumTraces; ++i) outputs[i] = { -1, nullptr, 0, false };
+  }
+  ~Printer() { Finish(); }
+
+  int handle_event(TraceId trace_id, Event& event) override;
+  // Submits whatever is left in the buffers.
+  void Finish() override;
+
+private:
+  struct Output {
+    int fd;
+    char* buffer;
+    u32 len;
+    bool dropped;   // the trace's output couldn't be opened
+  };
+
+  char* FormatText(char* out, TraceId trace_id, Event& event);
+  char* FormatCsv(char* out, TraceId trace_id, Event& event);
+  char* FormatJson(char* out, TraceId trace_id, Event& event);
+
+  PrintWriter& writer;
+  PrintFormat format;
+  Output outputs[kNumTraces];   // only outputs[0] is used unless writing per-trace files
+};
+
 }   // namespace Monitor
 
-#endif
\ No newline at end of file
+#endif
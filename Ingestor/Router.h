@@ -0,0 +1,118 @@
+#ifndef MONITOR_ROUTER_H
+#define MONITOR_ROUTER_H
+
+#include <atomic>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/SpscQueue.h"
+#include "Common/Types.h"
+
+namespace Monitor {
+
+/** Optional stage between decoding and handling that sends each event on a single address to the
+ *  ingestor owning that address's shard, so that the state kept for an address (shadow memory, a
+ *  lock's table entry) is only ever touched by one ingestor. Events are passed through one SPSC
+ *  queue per (source, destination) pair.
+ *
+ *  Reads, writes, acquires, releases and atomic accesses are sharded by their address. Events
+ *  without one, covering an address range (memset/memcpy) or changing per-thread state (return,
+ *  fences, ignore begin/end) are broadcast to every shard. Since a trace is always decoded by the
+ *  same source and each queue is FIFO, every shard sees the events of a trace in program order.
+ */
+class Router {
+public:
+  static constexpr u32 kQueueSize = 0x400;
+  static constexpr u32 kPollBatch = 64;
+  static constexpr int kBroadcast = -1;
+
+  Router() {
+    for (u32 i = 0; i < kNumWorkers; ++i) finished[i] = false;
+  }
+
+  static inline int ShardOf(const IngestorEvent& event) {
+    switch (event.type) {
+    case READ:
+    case WRITE:
+    case ACQUIRE:
+    case RELEASE:
+    case ATOMICLOAD:
+    case ATOMICSTORE:
+    case ATOMICRMW:
+    case ATOMICCAS:
+      return ShardOfAddress(event.addr.value());
+    default:
+      return kBroadcast;
+    }
+  }
+
+  static inline int ShardOfAddress(u64 addr) {
+    // Keep a cache line in a single shard, then spread lines with a multiplicative hash.
+    u64 line = addr / kCacheLineSize;
+    return (line * 0x9e3779b97f4a7c15ull >> 32) % kNumWorkers;
+  }
+
+  // Sends an event decoded by ingestor `src` to the shard(s) owning it. Events for `src` itself are
+  // handled directly. While a queue is full, `src` keeps handling its own inbound events so that
+  // two ingestors routing to each other cannot deadlock.
+  template <typename F>
+  void Route(u32 src, TraceId trace_id, IngestorEvent& event, F&& handle) {
+    int shard = ShardOf(event);
+    if (shard != kBroadcast) {
+      Send(src, shard, trace_id, event, handle);
+      return;
+    }
+    for (u32 dst = 0; dst < kNumWorkers; ++dst) Send(src, dst, trace_id, event, handle);
+  }
+
+  // Handles events routed to `dst` by the other ingestors. Returns the number handled.
+  template <typename F>
+  u32 Poll(u32 dst, F&& handle) {
+    u32 num_handled = 0;
+    for (u32 src = 0; src < kNumWorkers; ++src) {
+      if (src == dst) continue;
+      auto& queue = queues[src][dst];
+      RoutedEvent* routed;
+      for (u32 i = 0; i < kPollBatch && (routed = queue.Front()); ++i) {
+        handle(routed->trace_id, routed->event);
+        queue.Pop();
+        num_handled++;
+      }
+    }
+    return num_handled;
+  }
+
+  // Called by `src` once it won't route any more events.
+  void Finish(u32 src) { finished[src].store(true, std::memory_order_release); }
+
+  // Whether every source has finished and everything routed to `dst` has been handled.
+  bool IsDrained(u32 dst) {
+    for (u32 src = 0; src < kNumWorkers; ++src)
+      if (!finished[src].load(std::memory_order_acquire)) return false;
+    for (u32 src = 0; src < kNumWorkers; ++src)
+      if (!queues[src][dst].Empty()) return false;
+    return true;
+  }
+
+private:
+  struct RoutedEvent {
+    TraceId trace_id;
+    IngestorEvent event;
+  };
+
+  template <typename F>
+  inline void Send(u32 src, u32 dst, TraceId trace_id, IngestorEvent& event, F&& handle) {
+    if (dst == src) {
+      handle(trace_id, event);
+      return;
+    }
+    while (!queues[src][dst].TryPush({ trace_id, event })) Poll(src, handle);
+  }
+
+  SpscQueue<RoutedEvent, kQueueSize> queues[kNumWorkers][kNumWorkers];   // [src][dst]
+  std::atomic<bool> finished[kNumWorkers];
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,278 @@
+#include "TraceStore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace Monitor {
+using namespace TraceStoreFormat;
+
+int TraceStore::handle_event(TraceId trace_id, Event& event) {
+  if (builders[trace_id] == nullptr) {
+    builders[trace_id].reset(new Builder());
+    if (!Open(trace_id, *builders[trace_id])) return 0;
+  }
+  Builder& builder = *builders[trace_id];
+  if (builder.blocks == nullptr) return 0;
+
+  u32 i = builder.num_events++;
+  u8 flags = (event.addr.has_value() ? kHasAddr : 0) | (event.read_value.has_value() ? kHasValue1 : 0) |
+             (event.write_value.has_value() ? kHasValue2 : 0) | (event.lock_counter.has_value() ? kHasLockCounter : 0);
+  u64 addr = event.addr.value_or(0);
+  builder.type[i] = event.type;
+  builder.flags[i] = flags;
+  builder.addr[i] = addr;
+  builder.value1[i] = event.read_value.value_or(0);
+  builder.value2[i] = event.write_value.value_or(0);
+  builder.lock_counter[i] = event.lock_counter.value_or(0);
+  builder.tsc[i] = event.tsc;
+
+  BlockIndex& meta = builder.meta;
+  meta.type_mask |= TypeBit(event.type);
+  if (event.tsc != 0) {
+    meta.min_tsc = std::min(meta.min_tsc, event.tsc);
+    meta.max_tsc = std::max(meta.max_tsc, event.tsc);
+  }
+  if (IsDataAccess(event.type, flags)) {
+    if (IsRangeEvent(event.type)) {
+      // [dest, dest + count), and for memcpy [source, source + count) too.
+      u64 count = event.count.value_or(0);
+      meta.num_range_events++;
+      meta.min_addr = std::min(meta.min_addr, addr);
+      meta.max_addr = std::max(meta.max_addr, addr + (count ? count - 1 : 0));
+      if (event.type == MEMCPY) {
+        u64 source = event.source.value_or(0);
+        meta.min_addr = std::min(meta.min_addr, source);
+        meta.max_addr = std::max(meta.max_addr, source + (count ? count - 1 : 0));
+      }
+    } else {
+      meta.min_addr = std::min(meta.min_addr, addr);
+      meta.max_addr = std::max(meta.max_addr, addr);
+      BloomAdd(meta.bloom, addr);
+    }
+  }
+
+  if (builder.num_events == kBlockNumEvents) WriteBlock(builder);
+  return 0;
+}
+
+bool TraceStore::Open(TraceId trace_id, Builder& builder) {
+  char file_name[512];
+  snprintf(file_name, sizeof(file_name), "%s/%u.blocks", dir.c_str(), trace_id);
+  builder.blocks = fopen(file_name, "wb");
+  if (builder.blocks == nullptr) {
+    perror(file_name);
+    return false;
+  }
+  snprintf(file_name, sizeof(file_name), "%s/%u.index", dir.c_str(), trace_id);
+  builder.index = fopen(file_name, "wb");
+  if (builder.index == nullptr) {
+    perror(file_name);
+    fclose(builder.blocks);
+    builder.blocks = nullptr;
+    return false;
+  }
+
+  builder.addr.reset(new u64[kBlockNumEvents]);
+  builder.value1.reset(new u64[kBlockNumEvents]);
+  builder.value2.reset(new u64[kBlockNumEvents]);
+  builder.lock_counter.reset(new u64[kBlockNumEvents]);
+  builder.tsc.reset(new u64[kBlockNumEvents]);
+  builder.type.reset(new u8[kBlockNumEvents]);
+  builder.flags.reset(new u8[kBlockNumEvents]);
+  StartBlock(builder);
+  return true;
+}
+
+void TraceStore::StartBlock(Builder& builder) {
+  memset(&builder.meta, 0, sizeof(BlockIndex));
+  builder.meta.offset = builder.offset;
+  builder.meta.first_seq = builder.next_seq;
+  builder.meta.min_addr = ~0ull;
+  builder.meta.max_addr = 0;
+  builder.meta.min_tsc = ~0ull;
+  builder.meta.max_tsc = 0;
+  builder.num_events = 0;
+}
+
+void TraceStore::WriteBlock(Builder& builder) {
+  u32 n = builder.num_events;
+  builder.meta.num_events = n;
+  bool ok = fwrite(builder.addr.get(), sizeof(u64), n, builder.blocks) == n &&
+            fwrite(builder.value1.get(), sizeof(u64), n, builder.blocks) == n &&
+            fwrite(builder.value2.get(), sizeof(u64), n, builder.blocks) == n &&
+            fwrite(builder.lock_counter.get(), sizeof(u64), n, builder.blocks) == n &&
+            fwrite(builder.tsc.get(), sizeof(u64), n, builder.blocks) == n &&
+            fwrite(builder.type.get(), 1, n, builder.blocks) == n &&
+            fwrite(builder.flags.get(), 1, n, builder.blocks) == n &&
+            fwrite(&builder.meta, sizeof(BlockIndex), 1, builder.index) == 1;
+  if (!ok) perror("trace store write");
+
+  builder.offset += BlockSize(n);
+  builder.next_seq += n;
+  StartBlock(builder);
+}
+
+void TraceStore::Finish() {
+  for (auto& builder : builders) {
+    if (builder == nullptr || builder->blocks == nullptr) continue;
+    if (builder->num_events > 0) WriteBlock(*builder);
+    fclose(builder->blocks);
+    fclose(builder->index);
+    builder->blocks = builder->index = nullptr;
+  }
+}
+
+TraceStoreReader::TraceStoreReader(const char* dir) : opened(false) {
+  for (u32 i = 0; i < kNumTraces; ++i) fds[i] = -1;
+  DIR* d = opendir(dir);
+  if (d == nullptr) {
+    perror(dir);
+    return;
+  }
+  closedir(d);
+  opened = true;
+
+  for (TraceId trace_id = 0; trace_id < kNumTraces; ++trace_id) {
+    char file_name[512];
+    snprintf(file_name, sizeof(file_name), "%s/%u.index", dir, trace_id);
+    FILE* index = fopen(file_name, "rb");
+    if (index == nullptr) continue;
+    Block block;
+    block.trace_id = trace_id;
+    while (fread(&block.index, sizeof(BlockIndex), 1, index) == 1) blocks.push_back(block);
+    fclose(index);
+
+    snprintf(file_name, sizeof(file_name), "%s/%u.blocks", dir, trace_id);
+    fds[trace_id] = open(file_name, O_RDONLY);
+    if (fds[trace_id] < 0) {
+      perror(file_name);
+      opened = false;
+    }
+  }
+}
+
+TraceStoreReader::~TraceStoreReader() {
+  for (u32 i = 0; i < kNumTraces; ++i)
+    if (fds[i] >= 0) close(fds[i]);
+}
+
+bool TraceStoreReader::MayMatch(const Block& block, const StoreQuery& query) const {
+  const BlockIndex& index = block.index;
+  if (query.trace_id != StoreQuery::kAllTraces && block.trace_id != (TraceId)query.trace_id) return false;
+  u64 last_seq = index.first_seq + index.num_events - 1;
+  if (last_seq < query.min_seq || index.first_seq > query.max_seq) return false;
+  if (!(index.type_mask & query.type_mask)) return false;
+  if (query.HasTscFilter() && (index.max_tsc < query.min_tsc || index.min_tsc > query.max_tsc)) return false;
+  if (!query.HasAddrFilter()) return true;
+
+  if (index.max_addr < query.min_addr || index.min_addr > query.max_addr) return false;
+  if (query.min_addr == query.max_addr && index.num_range_events == 0)
+    return BloomMayContain(index.bloom, query.min_addr);
+  return true;
+}
+
+bool TraceStoreReader::Scan(const Block& block, const StoreQuery& query, std::vector<u8>& buffer,
+                            std::vector<StoredEvent>& out) const {
+  const BlockIndex& index = block.index;
+  u32 n = index.num_events;
+  u64 size = BlockSize(n);
+  buffer.resize(size);
+  u64 len = 0;
+  while (len < size) {
+    ssize_t r = pread(fds[block.trace_id], &buffer[len], size - len, index.offset + len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      fprintf(stderr, "[!] Reading the block at %lu of trace %u: %s\n", index.offset, block.trace_id,
+              strerror(errno));
+      return false;
+    }
+    if (r == 0) {
+      fprintf(stderr, "[!] The blocks file of trace %u ends within the block at %lu\n", block.trace_id,
+              index.offset);
+      return false;
+    }
+    len += r;
+  }
+
+  const u64* addr = reinterpret_cast<const u64*>(buffer.data());
+  const u64* value1 = addr + n;
+  const u64* value2 = value1 + n;
+  const u64* lock_counter = value2 + n;
+  const u64* tsc = lock_counter + n;
+  const u8* type = reinterpret_cast<const u8*>(tsc + n);
+  const u8* flags = type + n;
+
+  bool filter_addr = query.HasAddrFilter();
+  bool filter_tsc = query.HasTscFilter();
+  u32 begin = query.min_seq > index.first_seq ? std::min<u64>(query.min_seq - index.first_seq, n) : 0;
+  u32 end = query.max_seq - index.first_seq < n ? query.max_seq - index.first_seq + 1 : n;
+  for (u32 i = begin; i < end; ++i) {
+    EventType t = (EventType)type[i];
+    if (!(TypeBit(t) & query.type_mask)) continue;
+    if (filter_tsc && (tsc[i] == 0 || tsc[i] < query.min_tsc || tsc[i] > query.max_tsc)) continue;
+    if (filter_addr) {
+      if (!IsDataAccess(t, flags[i])) continue;
+      bool match;
+      if (IsRangeEvent(t)) {
+        u64 last = addr[i] + (value2[i] ? value2[i] - 1 : 0);
+        match = addr[i] <= query.max_addr && last >= query.min_addr;
+        if (t == MEMCPY) {
+          u64 source_last = value1[i] + (value2[i] ? value2[i] - 1 : 0);
+          match |= value1[i] <= query.max_addr && source_last >= query.min_addr;
+        }
+      } else {
+        match = addr[i] >= query.min_addr && addr[i] <= query.max_addr;
+      }
+      if (!match) continue;
+    }
+    out.push_back({ block.trace_id, index.first_seq + i, t, flags[i], addr[i], value1[i], value2[i], lock_counter[i], tsc[i] });
+  }
+  return true;
+}
+
+bool TraceStoreReader::Query(const StoreQuery& query, u32 num_threads, std::vector<StoredEvent>& events,
+                             Stats* stats) const {
+  std::vector<const Block*> candidates;
+  for (const Block& block : blocks)
+    if (MayMatch(block, query)) candidates.push_back(&block);
+
+  num_threads = std::max<u32>(1, std::min<u32>(num_threads, candidates.size()));
+  std::vector<std::vector<StoredEvent>> results(num_threads);
+  std::atomic<size_t> next(0);
+  std::atomic<bool> ok(true);
+  auto scan = [&](u32 thread_i) {
+    std::vector<u8> buffer;
+    size_t i;
+    while ((i = next.fetch_add(1, std::memory_order_relaxed)) < candidates.size()) {
+      if (!Scan(*candidates[i], query, buffer, results[thread_i])) ok = false;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (u32 i = 1; i < num_threads; ++i) threads.emplace_back(scan, i);
+  scan(0);
+  for (auto& thread : threads) thread.join();
+
+  events.clear();
+  for (auto& result : results) events.insert(events.end(), result.begin(), result.end());
+  std::sort(events.begin(), events.end(), [](const StoredEvent& a, const StoredEvent& b) {
+    return a.trace_id != b.trace_id ? a.trace_id < b.trace_id : a.seq < b.seq;
+  });
+
+  if (stats != nullptr) {
+    stats->num_blocks = blocks.size();
+    stats->num_scanned = candidates.size();
+    stats->bytes_scanned = 0;
+    for (const Block* block : candidates) stats->bytes_scanned += BlockSize(block->index.num_events);
+  }
+  return ok;
+}
+
+}   // namespace Monitor
@@ -0,0 +1,196 @@
+#ifndef MONITOR_TRACESTORE_H
+#define MONITOR_TRACESTORE_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+#include "Ingestor.h"
+
+namespace Monitor {
+
+/** On-disk layout of a trace store directory.
+ *  Each trace gets `<trace_id>.blocks`, holding blocks of up to kBlockNumEvents consecutive events
+ *  stored column by column, and `<trace_id>.index`, holding one BlockIndex per block. Events are
+ *  numbered per trace from 0 (their sequence number), so blocks partition each trace in time; the
+ *  chunk stamps of their events (IngestorEvent::tsc) place them on the producers' common clock.
+ *  A block is laid out as addr[n], value1[n], value2[n], lock_counter[n], tsc[n] (u64 each), then
+ *  type[n] and flags[n] (u8 each), where value1 is the read value or source and value2 the written
+ *  value or count, as in IngestorEvent.
+ */
+namespace TraceStoreFormat {
+constexpr u32 kBlockNumEvents = 1 << 14;
+constexpr u32 kBloomBits = 1 << 16;
+constexpr u32 kBloomWords = kBloomBits / 64;
+constexpr u32 kBloomHashes = 3;
+
+// Which of an event's optional fields are set.
+enum Flags : u8 {
+  kHasAddr = 1,
+  kHasValue1 = 2,
+  kHasValue2 = 4,
+  kHasLockCounter = 8,
+};
+
+struct BlockIndex {
+  u64 offset;   // in the blocks file
+  u64 first_seq;
+  u32 num_events;
+  u32 type_mask;   // TypeBit of every event type in the block
+  // Zone map over the data addresses touched in the block, including memset/memcpy ranges.
+  // min_addr > max_addr if there are none.
+  u64 min_addr;
+  u64 max_addr;
+  // Range of the nonzero chunk stamps in the block. min_tsc > max_tsc if none were stamped.
+  u64 min_tsc;
+  u64 max_tsc;
+  // Memset/memcpy ranges aren't in the bloom filter, so blocks with any are always scanned.
+  u32 num_range_events;
+  u32 reserved;
+  u64 bloom[kBloomWords];   // data addresses of single accesses
+};
+
+inline u32 TypeBit(EventType type) { return 1u << (type < 31 ? type : 31); }
+
+inline u64 BlockSize(u32 num_events) { return num_events * (5 * sizeof(u64) + 2); }
+
+inline u64 BloomHash(u64 addr) {
+  // splitmix64 finalizer, so that neighbouring addresses spread out.
+  addr ^= addr >> 30;
+  addr *= 0xbf58476d1ce4e5b9ull;
+  addr ^= addr >> 27;
+  addr *= 0x94d049bb133111ebull;
+  return addr ^ (addr >> 31);
+}
+
+inline void BloomAdd(u64* bloom, u64 addr) {
+  u64 hash = BloomHash(addr);
+  for (u32 i = 0; i < kBloomHashes; ++i) {
+    u32 bit = (hash >> (16 * i)) & (kBloomBits - 1);
+    bloom[bit / 64] |= 1ull << (bit % 64);
+  }
+}
+
+inline bool BloomMayContain(const u64* bloom, u64 addr) {
+  u64 hash = BloomHash(addr);
+  for (u32 i = 0; i < kBloomHashes; ++i) {
+    u32 bit = (hash >> (16 * i)) & (kBloomBits - 1);
+    if (!(bloom[bit / 64] & (1ull << (bit % 64)))) return false;
+  }
+  return true;
+}
+
+// Whether the event's addr is a data address. RETURN carries a code address.
+inline bool IsDataAccess(EventType type, u8 flags) { return (flags & kHasAddr) && type != RETURN; }
+inline bool IsRangeEvent(EventType type) { return type == MEMSET || type == MEMCPY; }
+}   // namespace TraceStoreFormat
+
+/** Ingestor writing every event it sees into an indexed columnar store in `dir`, which can be
+ *  queried after the run with TraceStoreReader. Needs each trace to be handled by a single
+ *  ingestor, so it can't be used when sharding by address.
+ */
+class TraceStore : public Ingestor {
+public:
+  TraceStore(const char* dir) : dir(dir) {}
+  ~TraceStore() { Finish(); }
+
+  int handle_event(TraceId trace_id, Event& event) override;
+  // Writes out partially filled blocks and closes the files.
+  void Finish() override;
+
+private:
+  struct Builder {
+    FILE* blocks = nullptr;
+    FILE* index = nullptr;
+    u64 offset = 0;
+    u64 next_seq = 0;
+    u32 num_events = 0;
+    TraceStoreFormat::BlockIndex meta;
+    std::unique_ptr<u64[]> addr, value1, value2, lock_counter, tsc;
+    std::unique_ptr<u8[]> type, flags;
+  };
+
+  bool Open(TraceId trace_id, Builder& builder);
+  void StartBlock(Builder& builder);
+  void WriteBlock(Builder& builder);
+
+  std::string dir;
+  std::unique_ptr<Builder> builders[kNumTraces];
+};
+
+struct StoreQuery {
+  static constexpr int kAllTraces = -1;
+
+  int trace_id = kAllTraces;
+  // Inclusive range of data addresses; memset/memcpy events match if their range overlaps it.
+  u64 min_addr = 0;
+  u64 max_addr = ~0ull;
+  // Inclusive range of per-trace sequence numbers.
+  u64 min_seq = 0;
+  u64 max_seq = ~0ull;
+  // Inclusive range of chunk stamps. Events without one only match if this isn't set.
+  u64 min_tsc = 0;
+  u64 max_tsc = ~0ull;
+  u32 type_mask = ~0u;   // TypeBit of the types to match
+
+  bool HasAddrFilter() const { return min_addr != 0 || max_addr != ~0ull; }
+  bool HasTscFilter() const { return min_tsc != 0 || max_tsc != ~0ull; }
+};
+
+struct StoredEvent {
+  TraceId trace_id;
+  u64 seq;
+  EventType type;
+  u8 flags;
+  u64 addr;
+  u64 value1;
+  u64 value2;
+  u64 lock_counter;
+  u64 tsc;   // 0 if the chunk wasn't stamped
+};
+
+/** Answers StoreQuerys over a directory written by TraceStores. Blocks are pruned with their
+ *  index entries and the remaining ones are scanned in parallel.
+ */
+class TraceStoreReader {
+public:
+  struct Stats {
+    u64 num_blocks = 0;
+    u64 num_scanned = 0;
+    u64 bytes_scanned = 0;
+  };
+
+  // Loads every index in `dir` and opens the matching blocks files. Check `IsOpen` for failure.
+  TraceStoreReader(const char* dir);
+  ~TraceStoreReader();
+  TraceStoreReader(const TraceStoreReader&) = delete;
+  TraceStoreReader& operator=(const TraceStoreReader&) = delete;
+  bool IsOpen() const { return opened; }
+
+  // Puts the matching events in `events`, ordered by trace, then sequence number. Returns false if a
+  // block couldn't be read, in which case `events` misses its matches.
+  bool Query(const StoreQuery& query, u32 num_threads, std::vector<StoredEvent>& events,
+             Stats* stats = nullptr) const;
+
+private:
+  struct Block {
+    TraceId trace_id;
+    TraceStoreFormat::BlockIndex index;
+  };
+
+  bool MayMatch(const Block& block, const StoreQuery& query) const;
+  bool Scan(const Block& block, const StoreQuery& query, std::vector<u8>& buffer,
+            std::vector<StoredEvent>& out) const;
+
+  bool opened;
+  int fds[kNumTraces];   // blocks file of each trace with an index, -1 for the others
+  std::vector<Block> blocks;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -1,163 +1,156 @@
 
-#include <fcntl.h>
-#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdint.h>
 #include <string.h>
-#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include <atomic>
+#include <memory>
 
 #include "Common/Constants.h"
-#include "Common/SharedMemory.h"
 #include "Common/Types.h"
 #include "Common/Event.h"
+#include "Core/Monitor.h"
+#include "Ingestor/LockProfiler.h"
+#include "Ingestor/Printer.h"
+#include "Ingestor/TraceStore.h"
+#include "Transport/ChunkSender.h"
 
 
 using namespace Monitor;
 
-SharedMemory* shm;
-
-u64 num_events = 0;
-std::atomic_uint8_t stop;
-int pid;
+::Monitor::Monitor* monitor;
 
 void handle_sigint(int sig) {
-  stop.store(1);
-  // printf("Num events: %llu\n", num_events);
-  // exit(0);
+  monitor->Stop();
 }
 
-u64 off(u32 idx, u32 offset) { return (idx + offset) & BUF_IDX_MASK; }
-
-u64 handle_event(Sid sid, LoggedEvent ev, SharedMemory *shm) {
-  int steps = 0;
-  u64 value = 0, counter = 0, old_value = 0, new_value = 0;
-
-  switch (ev.event_type) {
-  case WRITE:
-  case READ:
-    steps = 1;
-    value = shm->Consume(sid).raw;
-    printf("[MONITOR] #%u/%u: %s %p %#llx\n", sid, ev.lap_num, eventtype_to_string(ev.event_type), ev.addr, value);
-    break;
-  case ATOMICLOAD:
-  case ATOMICSTORE:
-    steps = 2;
-    counter = shm->Consume(sid).raw;
-    value = shm->Consume(sid).raw;
-    printf("[MONITOR] #%u/%u: %s %p %#llx (#%u)\n", sid, ev.lap_num, eventtype_to_string(ev.event_type), ev.addr, value, counter);
-    break;
-  case ATOMICRMW:
-  case ATOMICCAS:
-    steps = 3;
-    counter = shm->Consume(sid).raw;
-    old_value = shm->Consume(sid).raw;
-    new_value = shm->Consume(sid).raw;
-    printf("[MONITOR] #%u/%u: %s %p %#llx %#llx (#%u)\n", sid, ev.lap_num, eventtype_to_string(ev.event_type), ev.addr, old_value, new_value, counter);
-    break;
-  default:
-    printf("[MONITOR] #%u/%u: %s %p\n", sid, ev.lap_num, eventtype_to_string(ev.event_type), ev.addr);
-    break;
-  }
-
-  return steps;
+void usage(const char* prog) {
+  printf("[!] Usage: %s <pid> [--format text|csv|json] [--output-dir <dir>]\n"
+         "          [--max-chunk-mb <mb>] [--control-interval-us <us>] [--compress-watermark <chunks>]\n"
+         "          [--spill-dir <dir>] [--lock-profile [--shard-by-address] | --store <dir> | --forward <host:port>]\n"
+         "          [--latency]\n"
+         "   or: %s --listen <port> [--format text|csv|json] [--output-dir <dir>] [--max-chunk-mb <mb>]\n"
+         "          [--lock-profile [--shard-by-address] | --store <dir>] [--latency]\n", prog, prog);
 }
 
-// Thread function
-void *worker(void *arg) {
-  u64* data = (u64*)arg;
-  Tid tid = *data;
-
-  u64 slot_counts[SLOTS_PER_WORKER];
-
-  for (u8 i = 0; i < SLOTS_PER_WORKER; ++i) {
-    Sid sid = i*NUM_WORKERS+tid;
-    shm->Open(sid);
-    slot_counts[i] = 0;
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
   }
 
-  // Tell the program it can start.
-  if (tid == 0) shm->Ready();
-
-  while (!stop.load()) {
-    for (u8 i = 0; i < SLOTS_PER_WORKER; ++i) {
-      Sid sid = i*NUM_WORKERS+tid;
-      if (!shm->IsOpened(sid)) continue;
-      do {
-        LoggedEvent ev = shm->Consume(sid);
-        if (ev.raw != kEvClear.raw) {
-          // Handle event
-          int steps = handle_event(sid, ev, shm);
-          slot_counts[i]++;
-
-          if (HasProgramEnded(ev)) {
-            shm->Close(sid);
-            stop.store(1);
-            printf("[MONITOR] #%u Exit!\n", sid);
-          }
-        }
-        else break;   // if data is not ready we dont want to loop
-      } while (slot_counts[i] % 16 != 0 && !stop);  // read up to cache line alignment to maximise throughput
+  int pid = 0;
+  int first_option = 2;
+  PrintFormat format = PrintFormat::TEXT;
+  const char* output_dir = nullptr;
+  bool lock_profile = false;
+  const char* store_dir = nullptr;
+  MonitorOptions options;
+
+  if (!strcmp(argv[1], "--listen")) {
+    if (argc < 3) {
+      usage(argv[0]);
+      return 1;
     }
+    options.listen_port = atoi(argv[2]);
+    first_option = 3;
+  } else {
+    pid = atoi(argv[1]);
   }
 
-  u64 total_count = 0;
-  for (u8 i = 0; i < SLOTS_PER_WORKER; ++i) {
-    total_count += slot_counts[i];
+  for (int i = first_option; i < argc; ++i) {
+    if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+      const char* name = argv[++i];
+      if (!strcmp(name, "text")) format = PrintFormat::TEXT;
+      else if (!strcmp(name, "csv")) format = PrintFormat::CSV;
+      else if (!strcmp(name, "json")) format = PrintFormat::JSON;
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--output-dir") && i + 1 < argc) {
+      output_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--shard-by-address")) {
+      options.shard_by_address = true;
+    } else if (!strcmp(argv[i], "--max-chunk-mb") && i + 1 < argc) {
+      options.max_chunk_bytes = (size_t)atoll(argv[++i]) << 20;
+    } else if (!strcmp(argv[i], "--control-interval-us") && i + 1 < argc) {
+      options.control_interval_us = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--compress-watermark") && i + 1 < argc) {
+      options.compress_watermark = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--spill-dir") && i + 1 < argc) {
+      options.spill_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--lock-profile")) {
+      lock_profile = true;
+    } else if (!strcmp(argv[i], "--store") && i + 1 < argc) {
+      store_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--forward") && i + 1 < argc) {
+      options.forward_to = argv[++i];
+    } else if (!strcmp(argv[i], "--latency")) {
+      options.report_latency = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
   }
 
-  *data = total_count;
-
-  for (Sid sid = 0; sid < SLOTS_PER_WORKER; ++sid) {
-    shm->Close(sid);
+  // These must outlive the monitor, whose ingestors flush into them when destroyed.
+  std::unique_ptr<PrintWriter> writer;
+  std::unique_ptr<LockProfile> profile;
+  if (store_dir != nullptr && lock_profile) {
+    fprintf(stderr, "[!] --store can't be combined with --lock-profile\n");
+    return 1;
+  }
+  // Exporting and storing need every event of a trace in one ingestor, in program order, and once.
+  if (options.shard_by_address && !lock_profile) {
+    fprintf(stderr, "[!] --shard-by-address only applies to --lock-profile\n");
+    return 1;
   }
 
-  return 0;
-}
-
+  // Every collector and ingestor caches a few batches of chunks, so a smaller pool could starve them.
+  size_t min_chunk_bytes = (size_t)kNumWorkers * 2 * ChunkCache::kCapacity * sizeof(Chunk);
+  // Forwarding also holds each sender's batch and its zero-copy sends until they complete.
+  if (options.forward_to != nullptr)
+    min_chunk_bytes += (size_t)kNumWorkers * (ChunkSender::kMaxInFlight + ChunkSender::kBatchSize) * sizeof(Chunk);
+  if (options.max_chunk_bytes < min_chunk_bytes) {
+    fprintf(stderr, "[!] --max-chunk-mb must be at least %zu\n", (min_chunk_bytes + (1 << 20) - 1) >> 20);
+    return 1;
+  }
+  if (options.forward_to != nullptr && (options.listen_port != 0 || lock_profile || store_dir != nullptr)) {
+    fprintf(stderr, "[!] --forward leaves analysis to the receiving monitor\n");
+    return 1;
+  }
+  if (options.listen_port != 0 && options.control_interval_us > 0) {
+    fprintf(stderr, "[!] --control-interval-us belongs on the forwarding monitor\n");
+    return 1;
+  }
 
-int main(int argc, char** argv)
-{
-  if (argc < 2) {
-    printf("[!] Usage: %s <pid>\n", argv[0]);
+  if (options.forward_to != nullptr) {
+    // Nothing is ingested here.
+  } else if (store_dir != nullptr) {
+    mkdir(store_dir, 0755);
+    options.make_ingestor = [store_dir](int) { return std::unique_ptr<Ingestor>(new TraceStore(store_dir)); };
+  } else if (lock_profile) {
+    profile.reset(new LockProfile());
+    options.make_ingestor = [&profile](int) { return std::unique_ptr<Ingestor>(new LockProfiler(*profile)); };
+  } else {
+    writer.reset(output_dir ? new PrintWriter(output_dir, format) : new PrintWriter(STDOUT_FILENO, format));
+    options.make_ingestor = [&writer](int) { return std::unique_ptr<Ingestor>(new Printer(*writer)); };
   }
 
-  pid = atoi(argv[1]);
-  shm = new SharedMemory(pid);
-  printf("[+] Monitor started on pid %d\n", pid);
+  monitor = new ::Monitor::Monitor(pid, options);
+  if (options.listen_port != 0) fprintf(stderr, "[+] Monitor listening on port %u\n", options.listen_port);
+  else fprintf(stderr, "[+] Monitor started on pid %d\n", pid);
 
   signal(SIGINT, handle_sigint);
 
-  stop.store(0);
-
-  pthread_t workers[NUM_WORKERS];
-  u64 worker_data[NUM_WORKERS];
-
-  // Spawn threads
-  for (int i = 0; i < NUM_WORKERS; i++) {
-    worker_data[i] = i;  // Assign a unique ID to each thread
-    if (pthread_create(&workers[i], NULL, worker, &worker_data[i]) != 0) {
-      perror("pthread_create");
-      exit(EXIT_FAILURE);
-    }
-  }
-
-  // Wait for all threads to complete
-  for (int i = 0; i < NUM_WORKERS; i++) {
-    if (pthread_join(workers[i], NULL) != 0) {
-      perror("pthread_join");
-      exit(EXIT_FAILURE);
-    }
-    printf("worker #%u: %lu\n", i, worker_data[i]);
-    num_events += worker_data[i];
-  }
-
-  printf("Num events: %lu\n", num_events);
+  monitor->Start();
 
-  delete shm;
+  delete monitor;
+  writer.reset();
+  if (profile) profile->Report(stdout);
 
   return 0;
 }
@@ -0,0 +1,100 @@
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Collector/ChunkCodec.h"
+#include "Collector/SpillFile.h"
+#include "Common/Event.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+static std::unique_ptr<Chunk> MakeChunk(TraceId trace_id, const std::vector<u64>& words) {
+  std::vector<AMEvent> buf(words.size());
+  for (size_t i = 0; i < words.size(); ++i) buf[i].store(RawEvent(words[i]));
+  std::unique_ptr<Chunk> chunk(new Chunk(trace_id, buf.data(), 0, words.size()));
+  chunk->SetTimestamps(0x1234567890ull, 0x1234567999ull);
+  return chunk;
+}
+
+// Compresses `chunk` and checks that decompressing gives back its unread events and stamps.
+static void CheckRoundTrip(Chunk& chunk, u32 first_unread = 0) {
+  std::vector<u8> packed(SpillFile::kMaxRecordSize);
+  u32 size = ChunkCodec::Compress(chunk, packed.data(), packed.size());
+  REQUIRE(size != 0);
+
+  std::unique_ptr<Chunk> out(new Chunk());
+  CHECK(ChunkCodec::Decompress(packed.data(), out.get()) == size);
+  CHECK(out->GetTraceId() == chunk.GetTraceId());
+  CHECK(out->GetProducedTsc() == chunk.GetProducedTsc());
+  CHECK(out->GetCollectedTsc() == chunk.GetCollectedTsc());
+  REQUIRE(out->Size() == chunk.Size() - first_unread);
+  bool equal = true;
+  for (u32 i = 0; i < out->Size(); ++i) equal &= out->Data()[i].raw == chunk.Data()[first_unread + i].raw;
+  CHECK(equal);
+}
+
+TEST(ChunkCodecRoundTripsEvents) {
+  // Event headers, nearby addresses and small values, as a program produces them.
+  std::vector<u64> words;
+  for (u32 i = 0; words.size() < Chunk::kChunkNumEvents; ++i) {
+    LoggedEvent event = RawEvent(0);
+    event.event_type = i % 3 == 0 ? WRITE : READ;
+    words.push_back(event.raw);
+    words.push_back(0x7f0000001000ull + (i % 64) * 8);
+    words.push_back(i);
+  }
+  words.resize(Chunk::kChunkNumEvents);
+  std::unique_ptr<Chunk> chunk = MakeChunk(3, words);
+  CheckRoundTrip(*chunk);
+
+  // It is meant to save memory on such chunks.
+  std::vector<u8> packed(sizeof(Chunk));
+  CHECK(ChunkCodec::Compress(*chunk, packed.data(), packed.size()) < Chunk::kChunkSize / 2);
+}
+
+TEST(ChunkCodecRoundTripsRandomWords) {
+  std::mt19937_64 rng(42);
+  std::vector<u64> words(Chunk::kChunkNumEvents);
+  for (u64& word : words) word = rng();
+  // Including the extremes of the zigzag deltas.
+  words[0] = 0;
+  words[1] = ~0ull;
+  words[2] = 1ull << 63;
+  words[3] = 0;
+  std::unique_ptr<Chunk> chunk = MakeChunk(kNumTraces - 1, words);
+  CheckRoundTrip(*chunk);
+}
+
+TEST(ChunkCodecRoundTripsPartialAndEmptyChunks) {
+  std::vector<u64> words = { 1, 2, 3, 0xdeaddead, 5 };
+  std::unique_ptr<Chunk> partial = MakeChunk(1, words);
+  CheckRoundTrip(*partial);
+
+  std::unique_ptr<Chunk> empty = MakeChunk(2, {});
+  CheckRoundTrip(*empty);
+}
+
+TEST(ChunkCodecOnlyKeepsUnreadEvents) {
+  std::vector<u64> words = { 10, 20, 30, 40, 50 };
+  std::unique_ptr<Chunk> chunk = MakeChunk(1, words);
+  chunk->Next();
+  chunk->Next();
+  std::vector<u8> packed(SpillFile::kMaxRecordSize);
+  REQUIRE(ChunkCodec::Compress(*chunk, packed.data(), packed.size()) != 0);
+  std::unique_ptr<Chunk> out(new Chunk());
+  ChunkCodec::Decompress(packed.data(), out.get());
+  REQUIRE(out->Size() == 3);
+  CHECK(out->Data()[0].raw == 30 && out->Data()[2].raw == 50);
+}
+
+TEST(ChunkCodecRejectsTooSmallBuffers) {
+  std::mt19937_64 rng(7);
+  std::vector<u64> words(Chunk::kChunkNumEvents);
+  for (u64& word : words) word = rng();
+  std::unique_ptr<Chunk> chunk = MakeChunk(1, words);
+  std::vector<u8> packed(sizeof(Chunk));
+  CHECK(ChunkCodec::Compress(*chunk, packed.data(), sizeof(ChunkCodec::Header)) == 0);
+  CHECK(ChunkCodec::Compress(*chunk, packed.data(), Chunk::kChunkSize / 2) == 0);
+}
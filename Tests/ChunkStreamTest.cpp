@@ -0,0 +1,147 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Collector/ChunkPool.h"
+#include "Collector/Collector.h"
+#include "Common/Tsc.h"
+#include "Tests/Test.h"
+#include "Tests/TestProgram.h"
+#include "Transport/ChunkReceiver.h"
+#include "Transport/ChunkSender.h"
+#include "Transport/ChunkStream.h"
+
+
+using namespace Monitor;
+
+// Listens on a free loopback port. Returns the socket and sets `address` to connect to it.
+static int ListenOnAnyPort(char* address, size_t size) {
+  int fd = ChunkStream::Listen(0);
+  if (fd < 0) return -1;
+  sockaddr_in6 addr = {};
+  socklen_t len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  snprintf(address, size, "127.0.0.1:%u", ntohs(addr.sin6_port));
+  return fd;
+}
+
+TEST(ChunkStreamForwardsChunksInOrder) {
+  char address[64];
+  int listen_fd = ListenOnAnyPort(address, sizeof(address));
+  REQUIRE(listen_fd >= 0);
+
+  std::vector<TraceId> trace_ids = { 1, 2, 3 };
+  TestProgram program(trace_ids);
+  ChunkPool pool;
+  // Compressing makes the collector hand out transient chunks, which the sender has to copy.
+  Collector collector(program.Shm(), pool, trace_ids.data(), trace_ids.size(), 100, 1);
+  std::thread collector_thread([&collector] { collector.Run(); });
+
+  bool program_ended = false;
+  std::thread sender_thread([&] {
+    ChunkSender sender(address, 5, collector);
+    while (true) {
+      if (Chunk* chunk = collector.TryTake()) {
+        sender.Send(chunk);
+        continue;
+      }
+      sender.Flush();
+      if (collector.IsFinished()) break;
+    }
+    sender.Finish();
+    program_ended = sender.HasProgramEnded();
+  });
+
+  ChunkStream::Hello hello;
+  int fd = ChunkReceiver::Accept(listen_fd, &hello);
+  REQUIRE(fd >= 0);
+  CHECK(hello.stream_i == 5);
+  ChunkPool receiver_pool;
+  std::unique_ptr<ChunkReceiver> receiver(new ChunkReceiver(fd, hello, receiver_pool));
+  std::thread receiver_thread([&receiver] { receiver->Run(); });
+
+  constexpr u64 kNumWords = 40 * Chunk::kChunkNumEvents + 7;
+  program.Start(kNumWords);
+  program.Join();
+  // What an ingestor does once it decodes the end of the program, which makes the sender stop.
+  receiver->NotifyProgramEnded();
+  collector.Stop();
+
+  // Stamps are rebased onto the receiver's clock, so they are never ahead of it.
+  bool stamped = true;
+  while (Chunk* chunk = receiver->Take()) {
+    program.Check(*chunk);
+    stamped &= chunk->GetProducedTsc() != 0 && chunk->GetCollectedTsc() >= chunk->GetProducedTsc() &&
+               chunk->GetCollectedTsc() <= ReadTsc();
+    receiver->Release(chunk);
+  }
+  CHECK(stamped);
+  for (TraceId trace_id : trace_ids) CHECK(program.NumChecked(trace_id) == kNumWords);
+
+  // The receiver hangs up once the stream ends, which lets the sender finish.
+  receiver_thread.join();
+  sender_thread.join();
+  collector_thread.join();
+  CHECK(program_ended);
+  receiver.reset();
+  close(listen_fd);
+}
+
+TEST(ChunkStreamRejectsOtherClients) {
+  char address[64];
+  int listen_fd = ListenOnAnyPort(address, sizeof(address));
+  REQUIRE(listen_fd >= 0);
+
+  int client = ChunkStream::Connect(address);
+  REQUIRE(client >= 0);
+  const char request[] = "GET / HTTP/1.0\r\n\r\n";
+  CHECK(send(client, request, sizeof(request), 0) > 0);
+  ChunkStream::Hello hello;
+  CHECK(ChunkReceiver::Accept(listen_fd, &hello) < 0);
+  close(client);
+  close(listen_fd);
+}
+
+TEST(ChunkStreamRejectsSilentClients) {
+  char address[64];
+  int listen_fd = ListenOnAnyPort(address, sizeof(address));
+  REQUIRE(listen_fd >= 0);
+
+  int client = ChunkStream::Connect(address);
+  REQUIRE(client >= 0);
+  auto start = std::chrono::steady_clock::now();
+  ChunkStream::Hello hello;
+  CHECK(ChunkReceiver::Accept(listen_fd, &hello) < 0);
+  CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2 * ChunkStream::kHelloTimeoutMs));
+  close(client);
+  close(listen_fd);
+}
+
+// Like a sender stopping early: its stream ends before it sent everything, and the receiver,
+// stopped, hangs up instead of waiting for more.
+TEST(ChunkStreamReceiverHangsUpWhenStopped) {
+  char address[64];
+  int listen_fd = ListenOnAnyPort(address, sizeof(address));
+  REQUIRE(listen_fd >= 0);
+
+  int client = ChunkStream::Connect(address);
+  REQUIRE(client >= 0);
+  ChunkStream::Hello hello = { ChunkStream::kMagic, 0, TscPerNs() };
+  CHECK(send(client, &hello, sizeof(hello), 0) == sizeof(hello));
+  int fd = ChunkReceiver::Accept(listen_fd, &hello);
+  REQUIRE(fd >= 0);
+  ChunkPool pool;
+  std::unique_ptr<ChunkReceiver> receiver(new ChunkReceiver(fd, hello, pool));
+  receiver->Stop();
+  u8 message;
+  CHECK(recv(client, &message, 1, 0) == 0);
+  receiver->Run();
+  CHECK(receiver->Take() == nullptr);
+  close(client);
+  close(listen_fd);
+}
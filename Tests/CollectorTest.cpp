@@ -0,0 +1,117 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <csignal>
+#include <sys/resource.h>
+
+#include "Collector/ChunkPool.h"
+#include "Collector/Collector.h"
+#include "Tests/Test.h"
+#include "Tests/TestProgram.h"
+
+
+using namespace Monitor;
+
+static constexpr u32 kFlushLatencyUs = 100;
+
+// Takes everything `collector` hands over until it has stopped, checking it against `program`.
+static void TakeAll(Collector& collector, TestProgram& program) {
+  while (Chunk* chunk = collector.Take()) {
+    program.Check(*chunk);
+    collector.Release(chunk);
+  }
+}
+
+static bool WaitFor(TestProgram& program, std::chrono::seconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!program.IsFinished() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return program.IsFinished();
+}
+
+TEST(CollectorDeliversEveryTraceInOrder) {
+  std::vector<TraceId> trace_ids = { 1, 2, 3, 4 };
+  TestProgram program(trace_ids);
+  ChunkPool pool;
+  // Compress almost everything, so packs and raw chunks alternate in the queue.
+  Collector collector(program.Shm(), pool, trace_ids.data(), trace_ids.size(), kFlushLatencyUs, 2);
+  std::thread collector_thread([&collector] { collector.Run(); });
+
+  constexpr u64 kNumWords = 50 * Chunk::kChunkNumEvents + 123;
+  program.Start(kNumWords);
+  program.Join();
+  collector.Stop();
+  TakeAll(collector, program);
+  collector_thread.join();
+
+  // Including the partially filled last chunk of each trace.
+  for (TraceId trace_id : trace_ids) CHECK(program.NumChecked(trace_id) == kNumWords);
+}
+
+TEST(CollectorSpillsInsteadOfBlockingAndKeepsOrder) {
+  std::vector<TraceId> trace_ids = { 1, 2, 3, 4 };
+  TestProgram program(trace_ids);
+  // Far less than the program writes while nobody ingests.
+  ChunkPool pool(64 * sizeof(Chunk));
+  Collector collector(program.Shm(), pool, trace_ids.data(), trace_ids.size(), kFlushLatencyUs, 16, "/tmp");
+  std::thread collector_thread([&collector] { collector.Run(); });
+
+  constexpr u64 kNumWords = 200 * Chunk::kChunkNumEvents;
+  program.Start(kNumWords);
+  // Without spilling, the program would be stuck on its full buffers until we take chunks.
+  CHECK(WaitFor(program, std::chrono::seconds(60)));
+
+  // Take part of the backlog, then stop, so that Drain has to empty the spill file. Keep taking
+  // until the program is done in case it did block.
+  for (u32 i = 0; i < 100 || !program.IsFinished(); ++i) {
+    Chunk* chunk = collector.Take();
+    REQUIRE(chunk != nullptr);
+    program.Check(*chunk);
+    collector.Release(chunk);
+  }
+  program.Join();
+  collector.Stop();
+  TakeAll(collector, program);
+  collector_thread.join();
+
+  for (TraceId trace_id : trace_ids) CHECK(program.NumChecked(trace_id) == kNumWords);
+}
+
+TEST(CollectorFallsBackToBlockingWhenSpillingFails) {
+  std::vector<TraceId> trace_ids = { 1, 2, 3, 4 };
+  TestProgram program(trace_ids);
+
+  // From here on, spill writes fail with EFBIG instead of raising SIGXFSZ.
+  rlimit old_limit;
+  getrlimit(RLIMIT_FSIZE, &old_limit);
+  rlimit limit = old_limit;
+  limit.rlim_cur = 0;
+  setrlimit(RLIMIT_FSIZE, &limit);
+  auto old_handler = signal(SIGXFSZ, SIG_IGN);
+
+  ChunkPool pool(64 * sizeof(Chunk));
+  Collector collector(program.Shm(), pool, trace_ids.data(), trace_ids.size(), kFlushLatencyUs, 0, "/tmp");
+  std::thread collector_thread([&collector] { collector.Run(); });
+
+  // Enough to fill the spill file's write buffer, so it is flushed and fails.
+  constexpr u64 kNumWords = 1000 * Chunk::kChunkNumEvents;
+  program.Start(kNumWords);
+  // Once spilling fails the program blocks, so this times out.
+  CHECK(!WaitFor(program, std::chrono::seconds(1)));
+  while (!program.IsFinished()) {
+    Chunk* chunk = collector.Take();
+    REQUIRE(chunk != nullptr);
+    program.Check(*chunk);
+    collector.Release(chunk);
+  }
+  program.Join();
+  collector.Stop();
+  TakeAll(collector, program);
+  collector_thread.join();
+
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  signal(SIGXFSZ, old_handler);
+  // Nothing is lost: the chunk that failed to spill is queued in its place.
+  for (TraceId trace_id : trace_ids) CHECK(program.NumChecked(trace_id) == kNumWords);
+}
@@ -0,0 +1,108 @@
+#include <initializer_list>
+#include <vector>
+
+#include "Common/Event.h"
+#include "Ingestor/Decoder.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+static LoggedEvent EventWord(EventType type) {
+  LoggedEvent event = RawEvent(0);
+  event.event_type = type;
+  return event;
+}
+
+// A chunk of `trace_id` holding `words`, as if the producer started it at `produced_tsc`.
+static Chunk MakeChunk(TraceId trace_id, std::initializer_list<LoggedEvent> words, u64 produced_tsc = 0) {
+  Chunk chunk(trace_id, words.size());
+  u32 i = 0;
+  for (LoggedEvent word : words) chunk.MutableData()[i++] = word;
+  chunk.SetTimestamps(produced_tsc, produced_tsc);
+  return chunk;
+}
+
+struct Decoded {
+  TraceId trace_id;
+  IngestorEvent event;
+};
+
+static u64 FeedInto(Decoder& decoder, Chunk chunk, std::vector<Decoded>& out) {
+  return decoder.Feed(chunk, [&out](TraceId trace_id, IngestorEvent& event) { out.push_back({ trace_id, event }); });
+}
+
+TEST(DecoderResumesEventsSplitAcrossChunks) {
+  Decoder decoder;
+  std::vector<Decoded> out;
+  CHECK(FeedInto(decoder, MakeChunk(3, { EventWord(READ), RawEvent(0x10) }, 100), out) == 0);
+  CHECK(decoder.IsSuspended(3));
+
+  CHECK(FeedInto(decoder, MakeChunk(3, { RawEvent(0x20), EventWord(WRITE), RawEvent(0x30), RawEvent(0x40) }, 200),
+                 out) == 2);
+  CHECK(!decoder.IsSuspended(3));
+  REQUIRE(out.size() == 2);
+  CHECK(out[0].trace_id == 3 && out[0].event.type == READ);
+  CHECK(out[0].event.addr == 0x10u && out[0].event.read_value == 0x20u && !out[0].event.write_value);
+  CHECK(out[1].event.type == WRITE && out[1].event.addr == 0x30u && out[1].event.write_value == 0x40u);
+}
+
+TEST(DecoderKeepsTracesApartWhileOneIsSuspended) {
+  Decoder decoder;
+  std::vector<Decoded> out;
+  // Trace 1 stops after the address and lock counter of a read-modify-write.
+  FeedInto(decoder, MakeChunk(1, { EventWord(ATOMICRMW), RawEvent(0x100), RawEvent(7) }), out);
+  CHECK(decoder.IsSuspended(1));
+  FeedInto(decoder, MakeChunk(2, { EventWord(ACQUIRE), RawEvent(0x200), RawEvent(3), EventWord(ATOMICFENCE) }), out);
+  CHECK(decoder.IsSuspended(1) && !decoder.IsSuspended(2));
+  FeedInto(decoder, MakeChunk(1, { RawEvent(0x11), RawEvent(0x12), EventWord(RETURN), RawEvent(0x300) }), out);
+
+  REQUIRE(out.size() == 4);
+  CHECK(out[0].trace_id == 2 && out[0].event.type == ACQUIRE && out[0].event.lock_counter == 3u);
+  CHECK(out[1].trace_id == 2 && out[1].event.type == ATOMICFENCE);
+  CHECK(out[2].trace_id == 1 && out[2].event.type == ATOMICRMW && out[2].event.addr == 0x100u);
+  CHECK(out[2].event.lock_counter == 7u && out[2].event.read_value == 0x11u && out[2].event.write_value == 0x12u);
+  CHECK(out[3].trace_id == 1 && out[3].event.type == RETURN && out[3].event.addr == 0x300u);
+  // Sequence numbers count each trace's events separately.
+  CHECK(out[0].event.seq == 0 && out[1].event.seq == 1);
+  CHECK(out[2].event.seq == 0 && out[3].event.seq == 1);
+}
+
+TEST(DecoderNotesProgramEnd) {
+  Decoder decoder;
+  std::vector<Decoded> out;
+  FeedInto(decoder, MakeChunk(4, { EventWord(WRITE), RawEvent(0x10), RawEvent(1) }), out);
+  CHECK(!decoder.HasProgramEnded());
+  // The end is reported on trace 0, between events, and isn't an event itself.
+  CHECK(FeedInto(decoder, MakeChunk(0, { EventWord(READ), RawEvent(0x20), RawEvent(2), kEvProgramEnded }), out) == 1);
+  CHECK(decoder.HasProgramEnded());
+  CHECK(!decoder.IsSuspended(0));
+  REQUIRE(out.size() == 2);
+  CHECK(out[1].trace_id == 0 && out[1].event.type == READ);
+}
+
+TEST(DecoderNumbersEventsAndStampsThemWithTheirFirstChunk) {
+  Decoder decoder;
+  std::vector<Decoded> out;
+  // Events of 3 words each, so they start at every offset of the 4-word chunks.
+  std::vector<LoggedEvent> words;
+  for (u64 i = 0; i < 8; ++i) {
+    words.push_back(EventWord(READ));
+    words.push_back(RawEvent(0x1000 + i));
+    words.push_back(RawEvent(i));
+  }
+  for (u32 c = 0; c < words.size() / 4; ++c) {
+    // The second chunk isn't stamped.
+    u64 tsc = c == 1 ? 0 : 1000 * (c + 1);
+    FeedInto(decoder, MakeChunk(9, { words[4 * c], words[4 * c + 1], words[4 * c + 2], words[4 * c + 3] }, tsc), out);
+  }
+
+  REQUIRE(out.size() == 8);
+  for (u64 i = 0; i < out.size(); ++i) {
+    u32 first_chunk = (3 * i) / 4;
+    u64 tsc = first_chunk == 1 ? 0 : 1000 * (first_chunk + 1);
+    CHECK(out[i].event.seq == i);
+    CHECK(out[i].event.read_value == i);
+    CHECK(out[i].event.tsc == tsc);
+  }
+}
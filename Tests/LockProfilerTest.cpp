@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Common/Event.h"
+#include "Ingestor/LockProfiler.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+static IngestorEvent LockEvent(EventType type, u64 addr, u64 counter, u64 seq) {
+  LoggedEvent words[kEventMaxArgs + 1] = {};
+  words[0].event_type = type;
+  words[1] = RawEvent(addr);
+  words[2] = RawEvent(counter);
+  IngestorEvent event = MakeIngestorEvent(words);
+  event.seq = seq;
+  return event;
+}
+
+static std::string ReportOf(LockProfile& profile) {
+  char* buffer = nullptr;
+  size_t size = 0;
+  FILE* out = open_memstream(&buffer, &size);
+  profile.Report(out);
+  fclose(out);
+  std::string report(buffer, size);
+  free(buffer);
+  return report;
+}
+
+static bool Contains(const std::string& report, const char* line) {
+  return report.find(line) != std::string::npos;
+}
+
+TEST(LockProfilerMeasuresHoldTimesInEventsOfTheHolder) {
+  LockProfile profile;
+  LockProfiler profiler(profile);
+  // A nested acquire doesn't end the hold, and other events of the trace count toward it.
+  IngestorEvent events[] = { LockEvent(ACQUIRE, 0x100, 0, 10), LockEvent(ACQUIRE, 0x100, 1, 12),
+                             LockEvent(RELEASE, 0x100, 2, 15), LockEvent(RELEASE, 0x100, 3, 20),
+                             LockEvent(ACQUIRE, 0x100, 4, 30), LockEvent(RELEASE, 0x100, 5, 33) };
+  for (IngestorEvent& event : events) profiler.handle_event(1, event);
+  profiler.Finish();
+
+  std::string report = ReportOf(profile);
+  CHECK(Contains(report, "=== Lock profile: 1 locks ===\n"));
+  CHECK(Contains(report, "Hold time (events): count=2 mean=6.5 p50<=3 p99<=15\n"));
+  CHECK(Contains(report, "  0x100: acquires=3 owner_changes=0 hold_mean=6.5 hold_p99<=15 out_of_order=0 traces=1\n"));
+  CHECK(!Contains(report, "[!]"));
+}
+
+// Two ingestors each see one trace's side of a lock, like unsharded ingestors of different traces.
+TEST(LockProfilerOrdersOperationsMergedFromSeveralIngestors) {
+  LockProfile profile;
+  LockProfiler profilers[] = { LockProfiler(profile), LockProfiler(profile) };
+  // Owners by lock counter: 1, 2, 2, 1, 2, so 3 owner changes; the other lock only has trace 1.
+  TraceId owners[] = { 1, 2, 2, 1, 2 };
+  u64 seqs[3] = {};
+  for (u64 i = 0; i < 5; ++i) {
+    TraceId trace_id = owners[i];
+    LockProfiler& profiler = profilers[trace_id - 1];
+    IngestorEvent acquire = LockEvent(ACQUIRE, 0x200, 2 * i, seqs[trace_id]++);
+    IngestorEvent release = LockEvent(RELEASE, 0x200, 2 * i + 1, seqs[trace_id]++);
+    profiler.handle_event(trace_id, acquire);
+    profiler.handle_event(trace_id, release);
+  }
+  IngestorEvent acquire = LockEvent(ACQUIRE, 0x300, 0, seqs[1]++);
+  IngestorEvent release = LockEvent(RELEASE, 0x300, 1, seqs[1]++);
+  profilers[0].handle_event(1, acquire);
+  profilers[0].handle_event(1, release);
+  // The second ingestor merges first, so its operations arrive before older ones of the first.
+  profilers[1].Finish();
+  profilers[0].Finish();
+
+  std::string report = ReportOf(profile);
+  CHECK(Contains(report, "=== Lock profile: 2 locks ===\n"));
+  size_t first =
+    report.find("  0x200: acquires=5 owner_changes=3 hold_mean=1.0 hold_p99<=1 out_of_order=0 traces=1,2\n");
+  size_t second = report.find("  0x300: acquires=1 owner_changes=0");
+  CHECK(first != std::string::npos && second != std::string::npos && first < second);
+  CHECK(!Contains(report, "[!]"));
+}
+
+TEST(LockProfilerCountsOperationsThatArriveTooLateToOrder) {
+  LockProfile profile;
+  Histogram hold;
+  std::bitset<kNumTraces> traces;
+  traces.set(1);
+  traces.set(2);
+  // Enough operations of trace 1 that the oldest are folded...
+  std::vector<LockOp> ops;
+  for (u64 i = 0; i <= LockProfile::kMaxPendingOps; ++i) ops.push_back({ 100 + i, 1, i % 2 == 0 });
+  profile.Merge(0x400, ops.size() / 2, hold, traces, ops);
+  // ... before trace 2's older ones show up.
+  std::vector<LockOp> late = { { 10, 2, true }, { 11, 2, false } };
+  profile.Merge(0x400, 1, hold, traces, late);
+
+  std::string report = ReportOf(profile);
+  CHECK(Contains(report, "[!] 2 lock operations arrived too late to be ordered\n"));
+  CHECK(Contains(report, "owner_changes=0 hold_mean=0.0 hold_p99<=0 out_of_order=2 traces=1,2\n"));
+}
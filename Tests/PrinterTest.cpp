@@ -0,0 +1,129 @@
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Common/Event.h"
+#include "Ingestor/Printer.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+static IngestorEvent MakeEvent(EventType type, std::initializer_list<u64> args) {
+  LoggedEvent words[kEventMaxArgs + 1] = {};
+  words[0].event_type = type;
+  u32 i = 1;
+  for (u64 arg : args) words[i++] = RawEvent(arg);
+  return MakeIngestorEvent(words);
+}
+
+static std::string ReadAll(const char* file_name) {
+  std::string content;
+  FILE* file = fopen(file_name, "r");
+  if (file == nullptr) return content;
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) content.append(buffer, n);
+  fclose(file);
+  return content;
+}
+
+// Prints a read, a memcpy and a fence of trace 3 and a write of trace 7 in `format`, to one file.
+static std::string PrintSample(PrintFormat format) {
+  char file_name[] = "/tmp/monitor-printer-XXXXXX";
+  int fd = mkstemp(file_name);
+  if (fd < 0) return "";
+  {
+    PrintWriter writer(fd, format);
+    Printer printer(writer);
+    IngestorEvent events[] = { MakeEvent(READ, { 0x10, 0x2a }), MakeEvent(MEMCPY, { 0x100, 0x200, 0x10 }),
+                               MakeEvent(ATOMICFENCE, {}) };
+    for (IngestorEvent& event : events) printer.handle_event(3, event);
+    IngestorEvent write = MakeEvent(WRITE, { 0x20, 0 });
+    printer.handle_event(7, write);
+    printer.Finish();
+  }
+  close(fd);
+  std::string content = ReadAll(file_name);
+  unlink(file_name);
+  return content;
+}
+
+TEST(PrinterWritesText) {
+  CHECK(PrintSample(PrintFormat::TEXT) == "#3: READ 0x10 0x2a\n"
+                                          "#3: MEMCPY 0x100 0x200 0x10\n"
+                                          "#3: ATOMICFENCE\n"
+                                          "#7: WRITE 0x20 0x0\n");
+}
+
+TEST(PrinterWritesCsv) {
+  CHECK(PrintSample(PrintFormat::CSV) == "trace_id,type,addr,read_value,write_value\n"
+                                         "3,READ,0x10,0x2a,\n"
+                                         "3,MEMCPY,0x100,0x200,0x10\n"
+                                         "3,ATOMICFENCE,,,\n"
+                                         "7,WRITE,0x20,,0x0\n");
+}
+
+TEST(PrinterWritesJsonLines) {
+  CHECK(PrintSample(PrintFormat::JSON) ==
+        "{\"trace_id\":3,\"type\":\"READ\",\"addr\":\"0x10\",\"read_value\":\"0x2a\"}\n"
+        "{\"trace_id\":3,\"type\":\"MEMCPY\",\"dest\":\"0x100\",\"source\":\"0x200\",\"count\":\"0x10\"}\n"
+        "{\"trace_id\":3,\"type\":\"ATOMICFENCE\"}\n"
+        "{\"trace_id\":7,\"type\":\"WRITE\",\"addr\":\"0x20\",\"write_value\":\"0x0\"}\n");
+}
+
+TEST(PrinterWritesEachTraceToItsOwnFile) {
+  char dir[] = "/tmp/monitor-printer-XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  {
+    PrintWriter writer(dir, PrintFormat::CSV);
+    Printer printer(writer);
+    IngestorEvent read = MakeEvent(READ, { 0x10, 0x2a });
+    // Enough lines to submit several buffers per trace.
+    for (u32 i = 0; i < 2 * PrintWriter::kPerTraceBufferSize / 16; ++i) {
+      printer.handle_event(1, read);
+      printer.handle_event(2, read);
+    }
+    printer.Finish();
+  }
+
+  std::string expected = "trace_id,type,addr,read_value,write_value\n";
+  for (u32 i = 0; i < 2 * PrintWriter::kPerTraceBufferSize / 16; ++i) expected += "1,READ,0x10,0x2a,\n";
+  std::string file_name = std::string(dir) + "/1.csv";
+  CHECK(ReadAll(file_name.c_str()) == expected);
+  unlink(file_name.c_str());
+  file_name = std::string(dir) + "/2.csv";
+  CHECK(ReadAll(file_name.c_str()).size() == expected.size());
+  unlink(file_name.c_str());
+  rmdir(dir);
+}
+
+TEST(PrinterGivesUpOnATraceWhoseFileCantBeOpened) {
+  char dir[] = "/tmp/monitor-printer-XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  rmdir(dir);
+  {
+    PrintWriter writer(dir, PrintFormat::TEXT);
+    Printer printer(writer);
+    IngestorEvent read = MakeEvent(READ, { 0x10, 0x2a });
+    printer.handle_event(1, read);
+    CHECK(writer.FdFor(1) == -1);
+    // The failure sticks even once the file could be opened.
+    mkdir(dir, 0755);
+    CHECK(writer.FdFor(1) == -1);
+    printer.handle_event(1, read);
+    CHECK(writer.FdFor(2) >= 0);
+    printer.Finish();
+  }
+  std::string file_name = std::string(dir) + "/1.txt";
+  CHECK(access(file_name.c_str(), F_OK) != 0);
+  file_name = std::string(dir) + "/2.txt";
+  unlink(file_name.c_str());
+  rmdir(dir);
+}
@@ -0,0 +1,110 @@
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Ingestor/Router.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+static IngestorEvent MakeEvent(EventType type, u64 addr, u64 seq) {
+  LoggedEvent words[kEventMaxArgs + 1] = {};
+  words[0].event_type = type;
+  for (u32 i = 1; i <= kEventMaxArgs; ++i) words[i] = RawEvent(addr);
+  IngestorEvent event = MakeIngestorEvent(words);
+  event.seq = seq;
+  return event;
+}
+
+TEST(RouterShardsEventsOnOneAddress) {
+  for (EventType type : { READ, WRITE, ACQUIRE, RELEASE, ATOMICLOAD, ATOMICSTORE, ATOMICRMW, ATOMICCAS }) {
+    for (u64 addr = 0x1000; addr < 0x1000 + 64 * kCacheLineSize; addr += 24)
+      CHECK(Router::ShardOf(MakeEvent(type, addr, 0)) == Router::ShardOfAddress(addr));
+  }
+  for (EventType type : { MEMSET, MEMCPY, RETURN, ATOMICFENCE, ATEXIT, IGNOREBEGIN, IGNOREEND })
+    CHECK(Router::ShardOf(MakeEvent(type, 0x1000, 0)) == Router::kBroadcast);
+
+  // A cache line stays in one shard, and lines spread over all of them.
+  CHECK(Router::ShardOfAddress(0x1000) == Router::ShardOfAddress(0x1000 + kCacheLineSize - 1));
+  bool used[kNumWorkers] = {};
+  for (u64 line = 0; line < 1024; ++line) used[Router::ShardOfAddress(line * kCacheLineSize)] = true;
+  for (u32 i = 0; i < kNumWorkers; ++i) CHECK(used[i]);
+}
+
+// Every ingestor routes the events of its own trace while handling what the others route to it,
+// as Monitor::IngestSharded does, through queues far smaller than what is sent.
+TEST(RouterKeepsEachTraceInOrderPerShard) {
+  constexpr u64 kNumEvents = 20 * Router::kQueueSize;
+  std::unique_ptr<Router> router(new Router());
+  struct Received {
+    u64 num_events = 0;
+    u64 num_broadcasts = 0;
+    u64 next_seq[kNumWorkers] = {};
+    bool in_order = true;
+    bool in_shard = true;
+  };
+  std::unique_ptr<Received[]> received(new Received[kNumWorkers]);
+
+  std::vector<std::thread> threads;
+  for (u32 i = 0; i < kNumWorkers; ++i) {
+    threads.emplace_back([&router, &received, i] {
+      Received& mine = received[i];
+      auto handle = [&mine, i](TraceId trace_id, IngestorEvent& event) {
+        // Sequence numbers only grow within a trace, but shards see a subset of them.
+        mine.in_order &= event.seq >= mine.next_seq[trace_id];
+        mine.next_seq[trace_id] = event.seq + 1;
+        int shard = Router::ShardOf(event);
+        if (shard == Router::kBroadcast) mine.num_broadcasts++;
+        else mine.in_shard &= shard == (int)i;
+        mine.num_events++;
+      };
+      for (u64 seq = 0; seq < kNumEvents; ++seq) {
+        // Every 16th event is a fence, which every shard must see.
+        IngestorEvent event = seq % 16 == 15 ? MakeEvent(ATOMICFENCE, 0, seq)
+                                             : MakeEvent(seq % 2 ? WRITE : ACQUIRE, 0x10000 + seq * 8, seq);
+        router->Route(i, i, event, handle);
+      }
+      router->Finish(i);
+      while (!router->IsDrained(i)) router->Poll(i, handle);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  constexpr u64 kNumFences = kNumEvents / 16;
+  u64 num_events = 0;
+  for (u32 i = 0; i < kNumWorkers; ++i) {
+    CHECK(received[i].in_order);
+    CHECK(received[i].in_shard);
+    CHECK(received[i].num_broadcasts == kNumWorkers * kNumFences);
+    num_events += received[i].num_events;
+  }
+  // Sharded events arrive exactly once, broadcast ones once per shard.
+  CHECK(num_events == kNumWorkers * (kNumEvents - kNumFences) + kNumWorkers * kNumWorkers * kNumFences);
+}
+
+TEST(RouterIsDrainedOnlyOnceEverySourceIsDoneAndPolled) {
+  std::unique_ptr<Router> router(new Router());
+  u32 num_handled = 0;
+  auto handle = [&num_handled](TraceId, IngestorEvent&) { num_handled++; };
+
+  // Find an address owned by shard 1 and send it from shard 0.
+  u64 addr = 0;
+  while (Router::ShardOfAddress(addr) != 1) addr += kCacheLineSize;
+  IngestorEvent event = MakeEvent(READ, addr, 0);
+  router->Route(0, 0, event, handle);
+  CHECK(num_handled == 0);
+
+  for (u32 i = 0; i < kNumWorkers; ++i)
+    if (i != 0) router->Finish(i);
+  CHECK(!router->IsDrained(1));
+  router->Finish(0);
+  CHECK(!router->IsDrained(1));
+  CHECK(router->IsDrained(0));
+
+  CHECK(router->Poll(1, handle) == 1);
+  CHECK(num_handled == 1);
+  CHECK(router->IsDrained(1));
+}
@@ -0,0 +1,97 @@
+#include <memory>
+
+#include <unistd.h>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Core/SharedMemory.h"
+#include "Tests/Test.h"
+#include "Tools/FakeProducer.h"
+
+
+using namespace Monitor;
+
+/** A trace of this process with a producer following the control page's read count, and a
+ *  monitor side checking that it reads back the words 1, 2, 3, ... in order.
+ */
+struct ControlledTrace {
+  static constexpr TraceId kTraceId = 1;
+
+  ControlledTrace() : shm((FakeProducer::CreateDir(getpid()), getpid())), chunk(new Chunk()) {
+    shm.OpenControl();
+    shm.Open(kTraceId);
+    producer.reset(new FakeProducer(getpid(), kTraceId));
+  }
+  ~ControlledTrace() { shm.Close(kTraceId); }
+
+  const TraceControl& Control() { return shm.GetControl()->traces[kTraceId]; }
+
+  // Writes up to `n` words, fewer if the read count doesn't allow more.
+  void Write(u64 n) {
+    for (u64 i = 0; i < n && producer->TryPutWithin(Control(), RawEvent(next_word)); ++i) next_word++;
+    in_bounds &= producer->write_count <= Control().read_count.load() + kBufferNumEvents;
+  }
+
+  // Consumes everything written so far, in pieces no larger than the rest of a chunk.
+  void ConsumeAll() {
+    while (shm.ConsumePartialChunk(kTraceId, chunk.get())) {
+      for (u32 i = 0; i < chunk->Size(); ++i) in_order &= chunk->Data()[i].raw == next_read++;
+    }
+  }
+
+  SharedMemory shm;
+  std::unique_ptr<FakeProducer> producer;
+  std::unique_ptr<Chunk> chunk;
+  u64 next_word = 1;
+  u64 next_read = 1;
+  bool in_order = true;
+  bool in_bounds = true;
+};
+
+TEST(SharedMemoryReadCountWaitsForPartiallyFlushedChunks) {
+  ControlledTrace trace;
+  REQUIRE(trace.shm.GetControl() != nullptr);
+  REQUIRE(trace.producer->IsOpen());
+
+  trace.Write(Chunk::kChunkNumEvents + 10);
+  trace.ConsumeAll();
+  // The first chunk is done, but the next one has only been flushed in part.
+  CHECK(trace.Control().read_count.load() == Chunk::kChunkNumEvents);
+
+  for (u32 lap = 0; lap < 4; ++lap) {
+    // Fill the buffer as far as the read count allows, which must not reach the partially flushed
+    // chunk's next lap: finishing that chunk clears its first word.
+    trace.Write(kBufferNumEvents);
+    trace.ConsumeAll();
+    CHECK(trace.Control().read_count.load() == trace.next_read - 1);
+    // Flush part of a chunk again.
+    trace.Write(10 + lap);
+    trace.ConsumeAll();
+  }
+  CHECK(trace.in_order);
+  CHECK(trace.in_bounds);
+  CHECK(trace.next_read == trace.next_word);
+  CHECK(trace.next_read > 4 * kBufferNumEvents);
+}
+
+TEST(SharedMemoryStampsEveryPieceOfAChunkAlike) {
+  ControlledTrace trace;
+  REQUIRE(trace.producer->IsOpen());
+  std::atomic<u64>* chunk_tsc = trace.producer->header->chunk_tsc;
+
+  trace.Write(Chunk::kChunkNumEvents / 2);
+  REQUIRE(trace.shm.ConsumePartialChunk(ControlledTrace::kTraceId, trace.chunk.get()));
+  u64 stamp = trace.chunk->GetProducedTsc();
+  CHECK(stamp != 0 && stamp == chunk_tsc[0].load());
+
+  // What a producer starting the chunk's next lap would do before it is finished.
+  chunk_tsc[0].store(stamp + 1000);
+  trace.Write(Chunk::kChunkNumEvents);
+  REQUIRE(trace.shm.ConsumePartialChunk(ControlledTrace::kTraceId, trace.chunk.get()));
+  CHECK(trace.chunk->Size() == Chunk::kChunkNumEvents / 2);
+  CHECK(trace.chunk->GetProducedTsc() == stamp);
+
+  // The next chunk gets its own.
+  REQUIRE(trace.shm.ConsumePartialChunk(ControlledTrace::kTraceId, trace.chunk.get()));
+  CHECK(trace.chunk->GetProducedTsc() == chunk_tsc[1].load());
+}
@@ -0,0 +1,81 @@
+#include <memory>
+#include <vector>
+
+#include "Collector/SpillFile.h"
+#include "Common/Event.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+// Chunk `n` of trace `n % 3` holds the words n * kChunkNumEvents + 1, ..., so chunks read back can
+// be told apart.
+static void FillChunk(Chunk* chunk, u64 n, std::vector<AMEvent>& buf) {
+  for (u32 i = 0; i < Chunk::kChunkNumEvents; ++i) buf[i].store(RawEvent(n * Chunk::kChunkNumEvents + i + 1));
+  new (chunk) Chunk(n % 3, buf.data(), 0, Chunk::kChunkNumEvents - n % 5);
+  chunk->SetTimestamps(n, n + 1);
+}
+
+static bool IsChunk(const Chunk& chunk, u64 n) {
+  if (chunk.GetTraceId() != n % 3 || chunk.Size() != Chunk::kChunkNumEvents - n % 5) return false;
+  if (chunk.GetProducedTsc() != n || chunk.GetCollectedTsc() != n + 1) return false;
+  for (u32 i = 0; i < chunk.Size(); ++i)
+    if (chunk.Data()[i].raw != n * Chunk::kChunkNumEvents + i + 1) return false;
+  return true;
+}
+
+TEST(SpillFileReadsBackInOrder) {
+  SpillFile spill("/tmp");
+  REQUIRE(spill.IsOpen());
+  std::vector<AMEvent> buf(Chunk::kChunkNumEvents);
+  std::unique_ptr<Chunk> chunk(new Chunk());
+  CHECK(spill.Empty());
+  CHECK(!spill.Read(chunk.get()));
+
+  // Several times the write buffer, so most of it goes through the file. Read some back while
+  // still writing, as a collector does when its ingestor catches up for a moment.
+  constexpr u64 kNumChunks = 3 * SpillFile::kBufferSize / Chunk::kChunkSize;
+  u64 num_read = 0;
+  bool in_order = true;
+  for (u64 n = 0; n < kNumChunks; ++n) {
+    FillChunk(chunk.get(), n, buf);
+    REQUIRE(spill.Write(*chunk));
+    if (n % 7 == 0) {
+      REQUIRE(spill.Read(chunk.get()));
+      in_order &= IsChunk(*chunk, num_read++);
+    }
+  }
+  CHECK(!spill.Empty());
+  while (spill.Read(chunk.get())) in_order &= IsChunk(*chunk, num_read++);
+  CHECK(in_order);
+  CHECK(num_read == kNumChunks);
+  CHECK(spill.Empty());
+  CHECK(spill.NumBytes() == 0);
+
+  // Starts over once drained.
+  FillChunk(chunk.get(), 1000, buf);
+  CHECK(spill.Write(*chunk));
+  CHECK(spill.Read(chunk.get()) && IsChunk(*chunk, 1000));
+}
+
+TEST(SpillFileRespectsItsCap) {
+  SpillFile spill("/tmp", 4 * SpillFile::kMaxRecordSize);
+  REQUIRE(spill.IsOpen());
+  std::vector<AMEvent> buf(Chunk::kChunkNumEvents);
+  std::unique_ptr<Chunk> chunk(new Chunk());
+  u64 num_written = 0;
+  while (spill.HasRoom()) {
+    FillChunk(chunk.get(), num_written, buf);
+    REQUIRE(spill.Write(*chunk));
+    num_written++;
+  }
+  CHECK(num_written >= 4);
+  CHECK(!spill.Write(*chunk));
+
+  u64 num_read = 0;
+  bool in_order = true;
+  while (spill.Read(chunk.get())) in_order &= IsChunk(*chunk, num_read++);
+  CHECK(in_order);
+  CHECK(num_read == num_written);
+  CHECK(spill.HasRoom());
+}
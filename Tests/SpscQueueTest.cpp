@@ -0,0 +1,50 @@
+#include <thread>
+
+#include "Common/SpscQueue.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+TEST(SpscQueueIsFifoAndBounded) {
+  SpscQueue<u64, 4> queue;
+  CHECK(queue.Empty());
+  CHECK(queue.Front() == nullptr);
+  for (u64 i = 0; i < 4; ++i) CHECK(queue.TryPush(i));
+  CHECK(!queue.TryPush(4));
+
+  // Wrap around a few times.
+  for (u64 i = 0; i < 20; ++i) {
+    u64* front = queue.Front();
+    REQUIRE(front != nullptr);
+    CHECK(*front == i);
+    queue.Pop();
+    CHECK(queue.TryPush(i + 4));
+  }
+  for (u64 i = 20; i < 24; ++i) {
+    REQUIRE(queue.Front() != nullptr);
+    CHECK(*queue.Front() == i);
+    queue.Pop();
+  }
+  CHECK(queue.Empty());
+}
+
+TEST(SpscQueueHandsOverInOrderAcrossThreads) {
+  constexpr u64 kNumItems = 1 << 20;
+  static SpscQueue<u64, 64> queue;
+  std::thread producer([] {
+    for (u64 i = 0; i < kNumItems; ++i)
+      while (!queue.TryPush(i)) std::this_thread::yield();
+  });
+
+  bool in_order = true;
+  for (u64 i = 0; i < kNumItems; ++i) {
+    u64* front;
+    while ((front = queue.Front()) == nullptr) std::this_thread::yield();
+    in_order &= *front == i;
+    queue.Pop();
+  }
+  producer.join();
+  CHECK(in_order);
+  CHECK(queue.Empty());
+}
@@ -0,0 +1,55 @@
+#ifndef MONITOR_TEST_H
+#define MONITOR_TEST_H
+
+#include <cstdio>
+#include <vector>
+
+namespace Monitor {
+
+/** Minimal test registry for `make test`. A TEST body reports failures with CHECK, which records
+ *  them and carries on, or REQUIRE, which also returns from the test.
+ */
+struct TestCase {
+  const char* name;
+  void (*run)();
+};
+
+inline std::vector<TestCase>& TestCases() {
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+inline int& NumTestFailures() {
+  static int num_failures = 0;
+  return num_failures;
+}
+
+struct TestRegistrar {
+  TestRegistrar(const char* name, void (*run)()) { TestCases().push_back({ name, run }); }
+};
+
+}   // namespace Monitor
+
+#define TEST(name) \
+  static void name(); \
+  static ::Monitor::TestRegistrar name##_registrar(#name, name); \
+  static void name()
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      ::Monitor::NumTestFailures()++; \
+    } \
+  } while (0)
+
+#define REQUIRE(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__, #cond); \
+      ::Monitor::NumTestFailures()++; \
+      return; \
+    } \
+  } while (0)
+
+#endif
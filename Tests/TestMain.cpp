@@ -0,0 +1,28 @@
+// Runs the tests registered with TEST, or only those whose name contains the first argument.
+//
+// Usage: ./MonitorTest [name-substring]
+
+#include <cstdio>
+#include <cstring>
+
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+  int num_run = 0, num_failed = 0;
+  for (const TestCase& test : TestCases()) {
+    if (filter != nullptr && strstr(test.name, filter) == nullptr) continue;
+    int failures_before = NumTestFailures();
+    test.run();
+    bool failed = NumTestFailures() != failures_before;
+    printf("[%s] %s\n", failed ? "FAIL" : " OK ", test.name);
+    fflush(stdout);
+    num_run++;
+    num_failed += failed;
+  }
+  printf("%d/%d tests passed\n", num_run - num_failed, num_run);
+  return num_failed == 0 ? 0 : 1;
+}
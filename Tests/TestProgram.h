@@ -0,0 +1,77 @@
+#ifndef MONITOR_TESTPROGRAM_H
+#define MONITOR_TESTPROGRAM_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+#include "Core/SharedMemory.h"
+#include "Tools/FakeProducer.h"
+#include "Tests/Test.h"
+
+namespace Monitor {
+
+/** Shared memory of this process with a thread per trace writing the words 1, 2, 3, ... into it,
+ *  and a check that collected chunks hand those words over in order.
+ */
+class TestProgram {
+public:
+  TestProgram(const std::vector<TraceId>& trace_ids) : trace_ids(trace_ids), num_finished(0) {
+    int pid = getpid();
+    FakeProducer::CreateDir(pid);
+    shm.reset(new SharedMemory(pid));
+    for (TraceId trace_id : trace_ids) {
+      shm->Open(trace_id);
+      producers.emplace_back(new FakeProducer(pid, trace_id));
+    }
+    for (u32 i = 0; i < kNumTraces; ++i) next_word[i] = 1;
+  }
+  ~TestProgram() {
+    Join();
+    for (TraceId trace_id : trace_ids) shm->Close(trace_id);
+  }
+
+  SharedMemory& Shm() { return *shm; }
+
+  void Start(u64 num_words) {
+    for (auto& producer : producers) {
+      threads.emplace_back([this, &producer, num_words] {
+        for (u64 i = 1; i <= num_words; ++i) producer->Put(RawEvent(i));
+        num_finished++;
+      });
+    }
+  }
+  void Join() {
+    for (auto& thread : threads) thread.join();
+    threads.clear();
+  }
+  bool IsFinished() const { return num_finished == producers.size(); }
+
+  // Checks that `chunk` continues its trace where the previous one left off.
+  void Check(const Chunk& chunk) {
+    u64& next = next_word[chunk.GetTraceId()];
+    bool in_order = true;
+    for (u32 i = 0; i < chunk.Size(); ++i) in_order &= chunk.Data()[i].raw == next + i;
+    CHECK(in_order);
+    next += chunk.Size();
+  }
+  u64 NumChecked(TraceId trace_id) const { return next_word[trace_id] - 1; }
+
+private:
+  std::vector<TraceId> trace_ids;
+  std::unique_ptr<SharedMemory> shm;
+  std::vector<std::unique_ptr<FakeProducer>> producers;
+  std::vector<std::thread> threads;
+  std::atomic<u32> num_finished;
+  u64 next_word[kNumTraces];
+};
+
+}   // namespace Monitor
+
+#endif
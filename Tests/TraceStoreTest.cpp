@@ -0,0 +1,197 @@
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Common/Event.h"
+#include "Ingestor/TraceStore.h"
+#include "Tests/Test.h"
+
+
+using namespace Monitor;
+using namespace Monitor::TraceStoreFormat;
+
+static IngestorEvent MakeEvent(EventType type, std::initializer_list<u64> args, u64 tsc) {
+  LoggedEvent words[kEventMaxArgs + 1] = {};
+  words[0].event_type = type;
+  u32 i = 1;
+  for (u64 arg : args) words[i++] = RawEvent(arg);
+  IngestorEvent event = MakeIngestorEvent(words);
+  event.tsc = tsc;
+  return event;
+}
+
+/** A store of two traces written into a temporary directory, removed again when done.
+ *  Trace 1 has 2 full blocks and part of a third. Its events alternate reads and writes over 64
+ *  words at 0x100000, 0x110000 and 0x120000 for blocks 0, 1 and 2, and its chunk stamps grow by 100
+ *  every 1024 events from 1000. Trace 2 has a full block and part of a second, with the words at
+ *  0x200000 and 0x210000. Its first block is unstamped and holds a memcpy of 0x100 bytes from
+ *  0x900000 to 0x200000 at seq 5; its second is stamped 5000 and holds an acquire of 0x300000 at
+ *  seq kBlockNumEvents + 3.
+ */
+struct TestStore {
+  static constexpr u64 kNumEvents1 = 2 * kBlockNumEvents + 100;
+  static constexpr u64 kNumEvents2 = kBlockNumEvents + 10;
+
+  TestStore() {
+    if (mkdtemp(dir) == nullptr) return;
+    TraceStore store(dir);
+    for (u64 i = 0; i < kNumEvents1; ++i) {
+      u64 addr = 0x100000 + (i / kBlockNumEvents) * 0x10000 + (i % 64) * 8;
+      IngestorEvent event = MakeEvent(i % 2 ? WRITE : READ, { addr, i }, 1000 + (i / 1024) * 100);
+      store.handle_event(1, event);
+    }
+    for (u64 i = 0; i < kNumEvents2; ++i) {
+      u64 addr = 0x200000 + (i / kBlockNumEvents) * 0x10000 + (i % 64) * 8;
+      u64 tsc = i < kBlockNumEvents ? 0 : 5000;
+      IngestorEvent event = i == 5                    ? MakeEvent(MEMCPY, { 0x200000, 0x900000, 0x100 }, tsc)
+                            : i == kBlockNumEvents + 3 ? MakeEvent(ACQUIRE, { 0x300000, 7 }, tsc)
+                                                       : MakeEvent(i % 2 ? WRITE : READ, { addr, i }, tsc);
+      store.handle_event(2, event);
+    }
+    store.Finish();
+  }
+  ~TestStore() {
+    for (const char* name : { "1.blocks", "1.index", "2.blocks", "2.index" }) unlink(Path(name).c_str());
+    rmdir(dir);
+  }
+
+  std::string Path(const char* name) const { return std::string(dir) + "/" + name; }
+
+  char dir[32] = "/tmp/monitor-store-XXXXXX";
+};
+
+struct Result {
+  bool ok;
+  std::vector<StoredEvent> events;
+  TraceStoreReader::Stats stats;
+};
+
+static Result Run(const TestStore& store, const StoreQuery& query, u32 num_threads = 1) {
+  TraceStoreReader reader(store.dir);
+  Result result;
+  result.ok = reader.IsOpen() && reader.Query(query, num_threads, result.events, &result.stats);
+  return result;
+}
+
+TEST(TraceStoreFindsSingleAddressesThroughZoneMapsAndBloomFilters) {
+  TestStore store;
+  StoreQuery query;
+  query.min_addr = query.max_addr = 0x100000 + 3 * 8;
+  Result result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_blocks == 5);
+  // Only trace 1's first block has it in its address range.
+  CHECK(result.stats.num_scanned == 1);
+  CHECK(result.events.size() == kBlockNumEvents / 64);
+  for (const StoredEvent& event : result.events) {
+    CHECK(event.trace_id == 1 && event.seq % 64 == 3 && event.addr == query.min_addr);
+    CHECK(event.type == WRITE && event.value2 == event.seq);
+  }
+
+  // In the same range, but never accessed: the bloom filter skips the block.
+  query.min_addr = query.max_addr = 0x100000 + 3 * 8 + 4;
+  result = Run(store, query);
+  CHECK(result.ok && result.events.empty());
+  CHECK(result.stats.num_scanned == 0);
+}
+
+TEST(TraceStoreMatchesMemcpyRangesOnBothSides) {
+  TestStore store;
+  StoreQuery query;
+  query.min_addr = query.max_addr = 0x900010;
+  Result result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 1);
+  REQUIRE(result.events.size() == 1);
+  const StoredEvent& memcpy_event = result.events[0];
+  CHECK(memcpy_event.trace_id == 2 && memcpy_event.seq == 5 && memcpy_event.type == MEMCPY);
+  CHECK(memcpy_event.addr == 0x200000 && memcpy_event.value1 == 0x900000 && memcpy_event.value2 == 0x100);
+
+  // The words at 0x2000f8 and 0x200100, plus the memcpy's destination ending at 0x2000ff.
+  query.min_addr = 0x2000f8;
+  query.max_addr = 0x200100;
+  result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 1);
+  CHECK(result.events.size() == 2 * kBlockNumEvents / 64 + 1);
+  u32 num_memcpys = 0;
+  for (const StoredEvent& event : result.events) num_memcpys += event.type == MEMCPY;
+  CHECK(num_memcpys == 1);
+}
+
+TEST(TraceStoreFiltersBySeqTscAndType) {
+  TestStore store;
+  StoreQuery query;
+  query.trace_id = 1;
+  query.min_seq = kBlockNumEvents - 10;
+  query.max_seq = kBlockNumEvents + 9;
+  Result result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 2);
+  REQUIRE(result.events.size() == 20);
+  for (u64 i = 0; i < 20; ++i) CHECK(result.events[i].seq == query.min_seq + i);
+
+  // Trace 1's events 16 * 1024 to 18 * 1024, all in its second block. Trace 2 is stamped later, or not at all.
+  query = StoreQuery();
+  query.min_tsc = 1000 + 16 * 100;
+  query.max_tsc = 1000 + 17 * 100;
+  result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 1);
+  REQUIRE(result.events.size() == 2 * 1024);
+  CHECK(result.events.front().trace_id == 1 && result.events.front().seq == 16 * 1024);
+  CHECK(result.events.back().trace_id == 1 && result.events.back().seq == 18 * 1024 - 1);
+
+  query.min_tsc = query.max_tsc = 5000;
+  result = Run(store, query);
+  CHECK(result.ok && result.events.size() == 10);
+  CHECK(result.stats.num_scanned == 1);
+
+  query = StoreQuery();
+  query.type_mask = TypeBit(ACQUIRE);
+  result = Run(store, query);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 1);
+  REQUIRE(result.events.size() == 1);
+  const StoredEvent& acquire = result.events[0];
+  CHECK(acquire.trace_id == 2 && acquire.seq == kBlockNumEvents + 3 && acquire.addr == 0x300000);
+  CHECK((acquire.flags & kHasLockCounter) && acquire.lock_counter == 7 && acquire.tsc == 5000);
+}
+
+TEST(TraceStoreMergesThreadsResultsInOrder) {
+  TestStore store;
+  StoreQuery query;
+  Result result = Run(store, query, 4);
+  REQUIRE(result.ok);
+  CHECK(result.stats.num_scanned == 5);
+  REQUIRE(result.events.size() == TestStore::kNumEvents1 + TestStore::kNumEvents2);
+  bool in_order = true;
+  for (u64 i = 0; i < result.events.size(); ++i) {
+    const StoredEvent& event = result.events[i];
+    TraceId trace_id = i < TestStore::kNumEvents1 ? 1 : 2;
+    u64 seq = i < TestStore::kNumEvents1 ? i : i - TestStore::kNumEvents1;
+    in_order &= event.trace_id == trace_id && event.seq == seq;
+  }
+  CHECK(in_order);
+}
+
+TEST(TraceStoreReportsBlocksItCantRead) {
+  TestStore store;
+  StoreQuery query;
+  CHECK(Run(store, query, 2).ok);
+
+  // Cut trace 1's file within its second block: the query fails, but still returns what it read.
+  REQUIRE(truncate(store.Path("1.blocks").c_str(), BlockSize(kBlockNumEvents) + 10) == 0);
+  Result result = Run(store, query, 2);
+  CHECK(!result.ok);
+  CHECK(result.events.size() == kBlockNumEvents + TestStore::kNumEvents2);
+
+  // An index without its blocks file.
+  unlink(store.Path("2.blocks").c_str());
+  TraceStoreReader reader(store.dir);
+  CHECK(!reader.IsOpen());
+}
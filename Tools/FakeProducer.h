@@ -0,0 +1,111 @@
+#ifndef MONITOR_FAKEPRODUCER_H
+#define MONITOR_FAKEPRODUCER_H
+
+#include <cstdio>
+#include <initializer_list>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Common/Tsc.h"
+#include "Common/Types.h"
+#include "Core/SharedMemory.h"
+
+namespace Monitor {
+
+/** Stands in for one thread of an instrumented program: maps a trace's shared file and writes to
+ *  it with the same blocking protocol, publishing TraceHeader::write_count and chunk stamps.
+ *  Used by the benchmarks, the tests and MonitorProducer.
+ */
+class FakeProducer {
+public:
+  // Creates the directory the monitor of `pid` expects, as the program does before starting.
+  static void CreateDir(int pid) {
+    char dir_name[64];
+    snprintf(dir_name, 64, "/tmp/tsan.monitor.%d", pid);
+    mkdir(dir_name, 0777);
+  }
+
+  // Maps trace `trace_id` of `pid`, creating its file if the monitor hasn't yet.
+  FakeProducer(int pid, TraceId trace_id) : buf(nullptr), header(nullptr), idx(0), write_count(0) {
+    char file_name[64];
+    snprintf(file_name, 64, "/tmp/tsan.monitor.%d/%d", pid, trace_id);
+    int fd = open(file_name, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+      perror(file_name);
+      return;
+    }
+    if (ftruncate(fd, kTraceMappingSize) == 0) {
+      void* mem = mmap(NULL, kTraceMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mem != MAP_FAILED) {
+        buf = reinterpret_cast<AMEvent*>(mem);
+        header = reinterpret_cast<TraceHeader*>(reinterpret_cast<char*>(buf) + kBufferSize);
+      }
+    }
+    close(fd);
+  }
+  ~FakeProducer() {
+    if (buf != nullptr) munmap(buf, kTraceMappingSize);
+  }
+  FakeProducer(const FakeProducer&) = delete;
+  FakeProducer& operator=(const FakeProducer&) = delete;
+
+  bool IsOpen() const { return buf != nullptr; }
+
+  // Only for trace 0: waits for the monitor's ready word, and writes after it.
+  void WaitForMonitor() {
+    while (buf[0].load().raw != kEvMonitorReady.raw) usleep(100);
+    header->chunk_tsc[0].store(ReadTsc(), std::memory_order_relaxed);
+    idx = 1;
+  }
+
+  // Returns false if the buffer is full.
+  inline bool TryPut(LoggedEvent event) {
+    if (idx % Chunk::kChunkNumEvents == 0) {
+      if (buf[idx].load().raw != kEvClear.raw) return false;
+      header->chunk_tsc[idx / Chunk::kChunkNumEvents].store(ReadTsc(), std::memory_order_relaxed);
+    }
+    buf[idx].store(event);
+    idx = (idx + 1) & kBufferIdxMask;
+    header->write_count.store(++write_count, std::memory_order_release);
+    return true;
+  }
+
+  // Like TryPut, but trusts the monitor's published read count instead of polling for a cleared
+  // chunk, as runtimes that map the control page do.
+  inline bool TryPutWithin(const TraceControl& control, LoggedEvent event) {
+    if (write_count >= control.read_count.load(std::memory_order_acquire) + kBufferNumEvents) return false;
+    if (idx % Chunk::kChunkNumEvents == 0)
+      header->chunk_tsc[idx / Chunk::kChunkNumEvents].store(ReadTsc(), std::memory_order_relaxed);
+    buf[idx].store(event);
+    idx = (idx + 1) & kBufferIdxMask;
+    header->write_count.store(++write_count, std::memory_order_release);
+    return true;
+  }
+
+  // Blocks while the buffer is full, like the program does.
+  inline void Put(LoggedEvent event) {
+    while (!TryPut(event));
+  }
+
+  // Writes an event followed by its args.
+  void PutEvent(EventType type, std::initializer_list<u64> args) {
+    LoggedEvent event = RawEvent(0);
+    event.event_type = type;
+    Put(event);
+    for (u64 arg : args) Put(RawEvent(arg));
+  }
+
+  AMEvent* buf;
+  TraceHeader* header;
+  u32 idx;
+  u64 write_count;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,137 @@
+// Fake instrumented program for running the monitor end to end without a TSan runtime.
+//
+// Usage: ./MonitorProducer [--events <n>] [--traces <n>] [--shared-locks] [--no-end]
+//
+// Prints its pid, waits for `./Monitor <pid>` to signal that it is ready, then writes <n> events
+// into each of <n> traces from as many threads, and kEvProgramEnded into trace 0 once they are all
+// done. Each trace gets a repeating mix of reads, writes, a lock section and an atomic
+// read-modify-write. By default every trace has its own lock, so the output of two runs can be
+// compared per trace; with --shared-locks the threads contend on two locks instead.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Common/Constants.h"
+#include "Common/Event.h"
+#include "Tools/FakeProducer.h"
+
+
+using namespace Monitor;
+
+static constexpr u64 kSharedLockAddr = 0x5000;
+static constexpr u64 kAtomicAddr = 0x6000;
+
+static std::mutex lock_mutexes[2];
+static u64 lock_counters[2];
+static std::atomic<u64> atomic_counter(0);
+
+static void usage(const char* prog) {
+  fprintf(stderr, "[!] Usage: %s [--events <n>] [--traces <n>] [--shared-locks] [--no-end]\n", prog);
+}
+
+// Spreads the traces over the collectors, which take every kNumWorkers-th trace.
+static TraceId TraceOf(u32 thread_i) {
+  return (thread_i * (kNumWorkers + 1)) % kNumTraces;
+}
+
+static void Produce(FakeProducer& producer, u32 thread_i, u64 num_events, bool shared_locks) {
+  u64 base = (u64)(thread_i + 1) << 32;
+  u64 lock_counter = 0;
+  u64 num_written = 0;
+  for (u64 j = 0; num_written < num_events; ++j) {
+    u64 addr = base + (j % 512) * 8;
+    switch (j % 8) {
+    case 0:
+    case 1:
+    case 4:
+      producer.PutEvent(READ, { addr, j });
+      num_written++;
+      break;
+    case 2:
+    case 5:
+    case 7:
+      producer.PutEvent(WRITE, { addr, j });
+      num_written++;
+      break;
+    case 3: {
+      // Acquire, a write inside the critical section, release.
+      if (shared_locks) {
+        u32 l = j % 2;
+        std::lock_guard<std::mutex> lock(lock_mutexes[l]);
+        producer.PutEvent(ACQUIRE, { kSharedLockAddr + l * kCacheLineSize, lock_counters[l]++ });
+        producer.PutEvent(WRITE, { kSharedLockAddr + 0x1000, j });
+        producer.PutEvent(RELEASE, { kSharedLockAddr + l * kCacheLineSize, lock_counters[l]++ });
+      } else {
+        producer.PutEvent(ACQUIRE, { base, lock_counter++ });
+        producer.PutEvent(WRITE, { addr, j });
+        producer.PutEvent(RELEASE, { base, lock_counter++ });
+      }
+      num_written += 3;
+      break;
+    }
+    case 6: {
+      u64 counter = shared_locks ? atomic_counter.fetch_add(1) : lock_counter++;
+      producer.PutEvent(ATOMICRMW, { shared_locks ? kAtomicAddr : base + 8, counter, j, j + 1 });
+      num_written++;
+      break;
+    }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  u64 num_events = 100000;
+  u32 num_traces = 4;
+  bool shared_locks = false;
+  bool end = true;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--events") && i + 1 < argc) {
+      num_events = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--traces") && i + 1 < argc) {
+      num_traces = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--shared-locks")) {
+      shared_locks = true;
+    } else if (!strcmp(argv[i], "--no-end")) {
+      end = false;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (num_traces < 1 || num_traces > kNumTraces) {
+    fprintf(stderr, "[!] --traces must be between 1 and %u\n", kNumTraces);
+    return 1;
+  }
+
+  int pid = getpid();
+  FakeProducer::CreateDir(pid);
+  std::vector<std::unique_ptr<FakeProducer>> producers;
+  for (u32 i = 0; i < num_traces; ++i) {
+    producers.emplace_back(new FakeProducer(pid, TraceOf(i)));
+    if (!producers.back()->IsOpen()) return 1;
+  }
+  printf("%d\n", pid);
+  fflush(stdout);
+
+  // Trace 0 is always the first one.
+  producers[0]->WaitForMonitor();
+
+  std::vector<std::thread> threads;
+  for (u32 i = 0; i < num_traces; ++i) {
+    threads.emplace_back([&producers, i, num_events, shared_locks] {
+      Produce(*producers[i], i, num_events, shared_locks);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  if (end) producers[0]->Put(kEvProgramEnded);
+  return 0;
+}
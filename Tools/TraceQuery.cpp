@@ -0,0 +1,123 @@
+// Queries a trace store written by `Monitor --store <dir>`.
+//
+// Usage: ./MonitorQuery <dir> [--addr <a> | --addr-range <lo> <hi>] [--trace <id>]
+//                       [--seq-range <lo> <hi>] [--tsc-range <lo> <hi>] [--types <t1,t2,...>]
+//                       [--threads <n>] [--count]
+//
+// Types are event names (read, write, atomicload, acquire, ...) or the groups `atomics` and `locks`.
+// Sequence numbers count the events of each trace from 0; they are printed as `#<trace>@<seq>`.
+// Stamps are the TSC values of when the producer started the chunk an event begins in, printed as
+// `tsc=<stamp>`; they order events across traces with the resolution of one chunk.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <thread>
+
+#include "Common/Event.h"
+#include "Ingestor/TraceStore.h"
+
+
+using namespace Monitor;
+using namespace Monitor::TraceStoreFormat;
+
+static void usage(const char* prog) {
+  fprintf(stderr, "[!] Usage: %s <dir> [--addr <a> | --addr-range <lo> <hi>] [--trace <id>]\n"
+                  "          [--seq-range <lo> <hi>] [--tsc-range <lo> <hi>] [--types <t1,t2,...>]\n"
+                  "          [--threads <n>] [--count]\n", prog);
+}
+
+static bool ParseTypes(char* list, u32& mask) {
+  static const EventType kAllTypes[] = { READ, WRITE, MEMSET, MEMCPY, ATOMICLOAD, ATOMICSTORE, ATOMICRMW,
+                                         ATOMICCAS, ATOMICFENCE, RETURN, ATEXIT, ACQUIRE, RELEASE,
+                                         IGNOREBEGIN, IGNOREEND };
+  mask = 0;
+  for (char* name = strtok(list, ","); name != nullptr; name = strtok(nullptr, ",")) {
+    if (!strcasecmp(name, "atomics")) {
+      for (EventType type : { ATOMICLOAD, ATOMICSTORE, ATOMICRMW, ATOMICCAS, ATOMICFENCE }) mask |= TypeBit(type);
+      continue;
+    }
+    if (!strcasecmp(name, "locks")) {
+      mask |= TypeBit(ACQUIRE) | TypeBit(RELEASE);
+      continue;
+    }
+    bool found = false;
+    for (EventType type : kAllTypes) {
+      if (strcasecmp(name, eventtype_to_string(type))) continue;
+      mask |= TypeBit(type);
+      found = true;
+    }
+    if (!found) {
+      fprintf(stderr, "[!] Unknown event type %s\n", name);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void Print(const StoredEvent& event) {
+  printf("#%u@%lu: %s", event.trace_id, event.seq, eventtype_to_string(event.type));
+  if (event.flags & kHasAddr) printf(" 0x%lx", event.addr);
+  if (event.flags & kHasValue1) printf(" 0x%lx", event.value1);
+  if (event.flags & kHasValue2) printf(" 0x%lx", event.value2);
+  if (event.flags & kHasLockCounter) printf(" counter=%lu", event.lock_counter);
+  if (event.tsc != 0) printf(" tsc=%lu", event.tsc);
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  StoreQuery query;
+  u32 num_threads = std::thread::hardware_concurrency();
+  bool count_only = false;
+  for (int i = 2; i < argc; ++i) {
+    if (!strcmp(argv[i], "--addr") && i + 1 < argc) {
+      query.min_addr = query.max_addr = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--addr-range") && i + 2 < argc) {
+      query.min_addr = strtoull(argv[++i], nullptr, 0);
+      query.max_addr = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      query.trace_id = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seq-range") && i + 2 < argc) {
+      query.min_seq = strtoull(argv[++i], nullptr, 0);
+      query.max_seq = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--tsc-range") && i + 2 < argc) {
+      query.min_tsc = strtoull(argv[++i], nullptr, 0);
+      query.max_tsc = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--types") && i + 1 < argc) {
+      if (!ParseTypes(argv[++i], query.type_mask)) return 1;
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--count")) {
+      count_only = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  TraceStoreReader reader(argv[1]);
+  if (!reader.IsOpen()) return 1;
+
+  auto start = std::chrono::steady_clock::now();
+  TraceStoreReader::Stats stats;
+  std::vector<StoredEvent> events;
+  bool ok = reader.Query(query, num_threads, events, &stats);
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  if (count_only) printf("%zu\n", events.size());
+  else for (const StoredEvent& event : events) Print(event);
+  fprintf(stderr, "[+] %zu events, scanned %lu of %lu blocks (%.1f MB) in %.1f ms\n", events.size(),
+          stats.num_scanned, stats.num_blocks, stats.bytes_scanned / 1e6, ms);
+  if (!ok) {
+    fprintf(stderr, "[!] Some blocks couldn't be read, their events are missing\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "ChunkReceiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Common/Tsc.h"
+
+
+namespace Monitor {
+using namespace ChunkStream;
+
+ChunkReceiver::ChunkReceiver(int fd, const Hello& hello, ChunkPool& pool) :
+  fd(fd), tsc_scale(TscPerNs() / hello.tsc_per_ns), stopped(false), done(false), notified(false), producer_cache(pool), consumer_cache(pool),
+  buffer(new u8[kBufferSize]), buffer_pos(0), buffer_len(0) {}
+
+ChunkReceiver::~ChunkReceiver() {
+  close(fd);
+}
+
+int ChunkReceiver::Accept(int listen_fd, Hello* hello) {
+  int fd = accept(listen_fd, nullptr, nullptr);
+  if (fd < 0) {
+    if (errno != EINTR) perror("accept");
+    return -1;
+  }
+
+  // A client that connects and stays silent mustn't hold up the streams after it.
+  timeval timeout = { kHelloTimeoutMs / 1000, (kHelloTimeoutMs % 1000) * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (recv(fd, hello, sizeof(Hello), MSG_WAITALL) != sizeof(Hello) || hello->magic != kMagic ||
+      hello->stream_i >= kNumWorkers || !(hello->tsc_per_ns > 0)) {
+    fprintf(stderr, "[!] Rejected a connection that isn't a chunk stream\n");
+    close(fd);
+    return -1;
+  }
+  timeout = {};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+void ChunkReceiver::Run() {
+  while (!stopped) {
+    FrameHeader header;
+    if (!Read(&header, sizeof(header))) break;
+    u64 arrived_tsc = ReadTsc();
+    if (header.trace_id >= kNumTraces || header.num_events > Chunk::kChunkNumEvents) {
+      fprintf(stderr, "[!] Malformed chunk stream, dropping the connection\n");
+      break;
+    }
+
+    // Not reading while we wait for memory is what slows the sender down.
+    Chunk* chunk;
+    while ((chunk = producer_cache.Allocate()) == nullptr && !stopped);
+    if (chunk == nullptr) break;
+
+    new (chunk) Chunk(header.trace_id, header.num_events);
+    if (!Read(chunk->MutableData(), header.num_events * sizeof(LoggedEvent))) {
+      producer_cache.Release(chunk);
+      break;
+    }
+    chunk->SetTimestamps(Rebase(header.produced_tsc, header.sent_tsc, arrived_tsc),
+                         Rebase(header.collected_tsc, header.sent_tsc, arrived_tsc));
+
+    bool pushed;
+    while (!(pushed = chunks.TryPush(chunk)) && !stopped);
+    if (!pushed) {
+      producer_cache.Release(chunk);
+      break;
+    }
+  }
+
+  // Everything the sender will send has been read, so it can close without losing any of it.
+  {
+    std::lock_guard<std::mutex> lock(send_mutex);
+    notified = true;
+    shutdown(fd, SHUT_WR);
+  }
+  done.store(true, std::memory_order_release);
+}
+
+u64 ChunkReceiver::Rebase(u64 stamp, u64 sent_tsc, u64 arrived_tsc) const {
+  if (stamp == 0) return 0;
+  u64 ago = stamp < sent_tsc ? (u64)((sent_tsc - stamp) * tsc_scale) : 0;
+  return arrived_tsc - std::min(ago, arrived_tsc - 1);
+}
+
+bool ChunkReceiver::Read(void* dst, size_t len) {
+  u8* out = static_cast<u8*>(dst);
+  while (len > 0) {
+    if (buffer_pos < buffer_len) {
+      size_t n = std::min<size_t>(len, buffer_len - buffer_pos);
+      memcpy(out, &buffer[buffer_pos], n);
+      buffer_pos += n;
+      out += n;
+      len -= n;
+      continue;
+    }
+
+    ssize_t n = recv(fd, buffer.get(), kBufferSize, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (n < 0 && !stopped) perror("chunk stream receive");
+      return false;
+    }
+    buffer_pos = 0;
+    buffer_len = n;
+  }
+  return true;
+}
+
+Chunk* ChunkReceiver::Take() {
+  while (true) {
+    if (Chunk* chunk = TryTake()) return chunk;
+    if (IsFinished()) return nullptr;
+  }
+}
+
+Chunk* ChunkReceiver::TryTake() {
+  Chunk** front = chunks.Front();
+  if (front == nullptr) {
+    // Same as Collector::TryTake, `Run` may be waiting for these.
+    consumer_cache.Flush();
+    return nullptr;
+  }
+  Chunk* chunk = *front;
+  chunks.Pop();
+  return chunk;
+}
+
+bool ChunkReceiver::IsFinished() {
+  // Everything has been pushed before `done` is set.
+  return done.load(std::memory_order_acquire) && chunks.Empty();
+}
+
+void ChunkReceiver::Release(Chunk* chunk) {
+  consumer_cache.Release(chunk);
+}
+
+void ChunkReceiver::Stop() {
+  stopped = true;
+  // Wakes up `Run` if it is blocked reading, and the sender if it waits for us to hang up.
+  shutdown(fd, SHUT_RDWR);
+}
+
+void ChunkReceiver::NotifyProgramEnded() {
+  std::lock_guard<std::mutex> lock(send_mutex);
+  if (notified) return;
+  notified = true;
+  u8 message = kProgramEnded;
+  if (send(fd, &message, 1, MSG_NOSIGNAL) < 0 && !stopped) perror("chunk stream send");
+}
+
+}   // namespace Monitor
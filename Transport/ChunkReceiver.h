@@ -0,0 +1,69 @@
+#ifndef MONITOR_CHUNKRECEIVER_H
+#define MONITOR_CHUNKRECEIVER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "Collector/ChunkPool.h"
+#include "Collector/Collector.h"
+#include "Common/Event.h"
+#include "Common/SpscQueue.h"
+#include "Common/Types.h"
+#include "ChunkStream.h"
+
+namespace Monitor {
+
+/** Receiving end of one ChunkSender's connection, standing in for a Collector: `Run` reads chunks
+ *  into the pool and the ingestor thread takes them with the same interface. While the pool or the
+ *  queue is full it stops reading, which lets TCP push back on the sender.
+ */
+class ChunkReceiver {
+public:
+  static constexpr u32 kMaxChunksInMem = Collector::kMaxChunksInMem;
+  static constexpr u32 kBufferSize = 1 << 18;
+
+  // Takes over `fd`, a connection whose `hello` has been read by `Accept`.
+  ChunkReceiver(int fd, const ChunkStream::Hello& hello, ChunkPool& pool);
+  ~ChunkReceiver();
+  ChunkReceiver(const ChunkReceiver&) = delete;
+  ChunkReceiver& operator=(const ChunkReceiver&) = delete;
+
+  // Accepts a connection on `listen_fd` and reads its Hello, waiting at most kHelloTimeoutMs for
+  // it. Returns the socket and fills in `hello`, or returns -1.
+  static int Accept(int listen_fd, ChunkStream::Hello* hello);
+
+  // Reads chunks until the sender ends the stream or `Stop` is called, then hangs up.
+  void Run();
+  // Same as Collector's.
+  Chunk* Take();
+  Chunk* TryTake();
+  bool IsFinished();
+  void Release(Chunk* chunk);
+  // Makes `Run` return without waiting for the sender, and hangs up on it.
+  void Stop();
+  // Tells the sender that the program has ended. Only the first call before hanging up does anything.
+  void NotifyProgramEnded();
+
+private:
+  bool Read(void* dst, size_t len);
+  // Moves a sender stamp onto our TSC, given when the frame carrying it was sent and arrived.
+  u64 Rebase(u64 stamp, u64 sent_tsc, u64 arrived_tsc) const;
+
+  int fd;
+  double tsc_scale;   // our TSC ticks per sender tick
+  std::atomic<bool> stopped;
+  std::atomic<bool> done;
+  std::mutex send_mutex;   // orders NotifyProgramEnded with hanging up
+  bool notified;   // or hung up, under send_mutex
+  ChunkCache producer_cache;   // only used by the thread calling `Run`
+  ChunkCache consumer_cache;   // only used by the single ingestor calling `Release`
+  std::unique_ptr<u8[]> buffer;
+  u32 buffer_pos;
+  u32 buffer_len;
+  SpscQueue<Chunk*, kMaxChunksInMem> chunks;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,225 @@
+#include "ChunkSender.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Common/Tsc.h"
+
+
+namespace Monitor {
+using namespace ChunkStream;
+
+ChunkSender::ChunkSender(const char* address, u32 stream_i, Collector& collector) :
+  collector(collector), fd(-1), zerocopy(false), program_ended(false), next_seq(0), num_completed(0),
+  next_header(0) {
+  batch.reserve(kBatchSize);
+  fd = Connect(address);
+  if (fd < 0) return;
+
+  Hello hello = { kMagic, stream_i, TscPerNs() };
+  iovec iov = { &hello, sizeof(hello) };
+  if (!SendAll(&iov, 1)) return;
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+  int one = 1;
+  zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+}
+
+ChunkSender::~ChunkSender() {
+  Finish();
+}
+
+void ChunkSender::Send(Chunk* chunk) {
+  bool owned = false;
+  if (collector.IsTransient(chunk)) {
+    // The collector reuses it on the next take, so the send needs its own copy.
+    if (free_copies.empty()) {
+      copies.emplace_back(new Chunk());
+      free_copies.push_back(copies.back().get());
+    }
+    Chunk* copy = free_copies.back();
+    free_copies.pop_back();
+    *copy = *chunk;
+    collector.Release(chunk);
+    chunk = copy;
+    owned = true;
+  }
+
+  batch.push_back({ chunk, owned, 0 });
+  if (batch.size() == kBatchSize) Flush();
+}
+
+void ChunkSender::Flush() {
+  if (batch.empty()) {
+    // Nothing new to send, but zero-copy sends may have completed and can give their chunks back.
+    Reap(false);
+    return;
+  }
+  if (fd < 0) {
+    // The connection is gone. Drop what the collector hands us so that it can still drain.
+    for (const Pending& pending : batch) Recycle(pending);
+    batch.clear();
+    return;
+  }
+
+  iovec iov[2 * kBatchSize];
+  u64 now = ReadTsc();
+  for (u32 i = 0; i < batch.size(); ++i) {
+    Chunk* chunk = batch[i].chunk;
+    FrameHeader& header = headers[next_header++ % kNumHeaders];
+    header = { chunk->GetTraceId(), chunk->Size(), chunk->GetProducedTsc(), chunk->GetCollectedTsc(), now };
+    iov[2 * i] = { &header, sizeof(FrameHeader) };
+    iov[2 * i + 1] = { chunk->MutableData(), chunk->Size() * sizeof(LoggedEvent) };
+  }
+  u32 first_seq = next_seq;
+  bool sent = SendAll(iov, 2 * batch.size());
+
+  for (Pending& pending : batch) {
+    // Even if zero-copy was given up halfway, the kernel may still be reading the batch.
+    if (sent && next_seq != first_seq) {
+      pending.seq = next_seq - 1;
+      in_flight.push_back(pending);
+    } else {
+      Recycle(pending);
+    }
+  }
+  batch.clear();
+
+  Reap(false);
+  while (in_flight.size() > kMaxInFlight) Reap(true);
+}
+
+bool ChunkSender::SendAll(iovec* iov, u32 iov_len) {
+  msghdr msg = {};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iov_len;
+  while (msg.msg_iovlen > 0) {
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_ZEROCOPY
+    if (zerocopy) flags |= MSG_ZEROCOPY;
+#endif
+    ssize_t sent = sendmsg(fd, &msg, flags);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      // Out of locked memory for pinning pages: fall back to copying.
+      if (errno == ENOBUFS && zerocopy) {
+        zerocopy = false;
+        continue;
+      }
+      perror("chunk stream send");
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    if (zerocopy) next_seq++;
+
+    // Skip what went out, in case it was only part of the message.
+    while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+      sent -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + sent;
+      msg.msg_iov->iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+void ChunkSender::Reap(bool block) {
+  if (in_flight.empty()) return;
+  if (fd < 0) {
+    // Nothing will complete any more, and the socket no longer references our memory.
+    while (!in_flight.empty()) {
+      Recycle(in_flight.front());
+      in_flight.pop_front();
+    }
+    return;
+  }
+
+  if (block) {
+    // Completions are reported on the error queue, which poll flags as POLLERR.
+    pollfd poll_fd = { fd, 0, 0 };
+    poll(&poll_fd, 1, 100);
+  }
+
+  while (true) {
+    char control[128];
+    msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      const sock_extended_err* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+      // Sends [ee_info, ee_data] are done.
+      num_completed = err->ee_data + 1;
+    }
+  }
+
+  while (!in_flight.empty() && (int)(in_flight.front().seq - num_completed) < 0) {
+    Recycle(in_flight.front());
+    in_flight.pop_front();
+  }
+}
+
+void ChunkSender::Recycle(const Pending& pending) {
+  if (pending.owned) free_copies.push_back(pending.chunk);
+  else collector.Release(pending.chunk);
+}
+
+bool ChunkSender::HasProgramEnded() {
+  if (program_ended || fd < 0) return program_ended;
+  u8 message;
+  if (recv(fd, &message, 1, MSG_DONTWAIT) == 1 && message == kProgramEnded) program_ended = true;
+  return program_ended;
+}
+
+void ChunkSender::Finish() {
+  Flush();
+  if (fd < 0) {
+    Reap(false);
+    return;
+  }
+
+  // Wait for the receiver to read everything and hang up, so that closing can't reset the
+  // connection under data it hasn't read yet. A receiver that never does is given up on.
+  shutdown(fd, SHUT_WR);
+  auto hang_up_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kHangUpTimeoutMs);
+  while (true) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(hang_up_deadline -
+                                                                      std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+      fprintf(stderr, "[!] The receiver didn't hang up, closing the stream anyway\n");
+      break;
+    }
+    pollfd poll_fd = { fd, POLLIN, 0 };
+    if (poll(&poll_fd, 1, left.count()) == 0) continue;
+    u8 message;
+    ssize_t n = recv(fd, &message, 1, MSG_DONTWAIT);
+    if (n == 1) {
+      if (message == kProgramEnded) program_ended = true;
+      continue;
+    }
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+    break;
+  }
+
+  // Everything has been acknowledged by now, so completions are at most a moment away.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (!in_flight.empty() && std::chrono::steady_clock::now() < deadline) Reap(true);
+  close(fd);
+  fd = -1;
+  Reap(false);
+}
+
+}   // namespace Monitor
@@ -0,0 +1,76 @@
+#ifndef MONITOR_CHUNKSENDER_H
+#define MONITOR_CHUNKSENDER_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "Collector/Collector.h"
+#include "Common/Event.h"
+#include "Common/Types.h"
+#include "ChunkStream.h"
+
+namespace Monitor {
+
+/** Forwards the chunks of one collector to a remote monitor, taking the place of its ingestor.
+ *  Chunks are sent in batches with a single sendmsg each. With MSG_ZEROCOPY the kernel reads them
+ *  straight from the pool, so they are only released once it reports completion, and no more than
+ *  kMaxInFlight are held that way. Flow control is TCP's own: when the receiver falls behind,
+ *  sending blocks, the collector's queue fills up, and the usual backpressure takes over.
+ *  Must only be used by the thread taking chunks from the collector.
+ */
+class ChunkSender {
+public:
+  static constexpr u32 kBatchSize = 16;
+  static constexpr u32 kMaxInFlight = 256;
+
+  ChunkSender(const char* address, u32 stream_i, Collector& collector);
+  ~ChunkSender();
+  ChunkSender(const ChunkSender&) = delete;
+  ChunkSender& operator=(const ChunkSender&) = delete;
+
+  bool IsConnected() const { return fd >= 0; }
+  bool IsZeroCopy() const { return zerocopy; }
+  // Queues `chunk` for sending and takes care of releasing it to the collector.
+  void Send(Chunk* chunk);
+  // Sends whatever is queued.
+  void Flush();
+  // Sends everything, waits for the receiver to take it all, and closes the connection.
+  void Finish();
+  // Whether the receiver has decoded the end of the program.
+  bool HasProgramEnded();
+
+private:
+  // Frame headers live in a ring so that they stay put until zero-copy sends complete.
+  static constexpr u32 kNumHeaders = 2 * (kMaxInFlight + kBatchSize);
+
+  struct Pending {
+    Chunk* chunk;
+    bool owned;   // a copy of a transient chunk, see Collector::IsTransient
+    u32 seq;   // zero-copy send it went out with
+  };
+
+  bool SendAll(iovec* iov, u32 iov_len);
+  // Releases chunks whose zero-copy sends have completed.
+  void Reap(bool block);
+  void Recycle(const Pending& pending);
+
+  Collector& collector;
+  int fd;
+  bool zerocopy;
+  bool program_ended;
+  u32 next_seq;   // of the next zero-copy send
+  u32 num_completed;   // zero-copy sends completed, which the kernel reports in order
+  ChunkStream::FrameHeader headers[kNumHeaders];
+  u32 next_header;
+  std::vector<Pending> batch;
+  std::deque<Pending> in_flight;
+  std::vector<std::unique_ptr<Chunk>> copies;
+  std::vector<Chunk*> free_copies;
+};
+
+}   // namespace Monitor
+
+#endif
@@ -0,0 +1,81 @@
+#include "ChunkStream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace Monitor {
+namespace ChunkStream {
+
+int Connect(const char* address) {
+  std::string host(address);
+  size_t colon = host.rfind(':');
+  if (colon == std::string::npos) {
+    fprintf(stderr, "[!] Expected host:port, got %s\n", address);
+    return -1;
+  }
+  std::string port = host.substr(colon + 1);
+  host.resize(colon);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result;
+  int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+  if (err != 0) {
+    fprintf(stderr, "[!] %s: %s\n", address, gai_strerror(err));
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0) {
+    perror(address);
+    return -1;
+  }
+
+  // Batches are already large; don't hold back the last segment of one.
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+int Listen(u16 port) {
+  int fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  int one = 1, zero = 0;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  // Accept IPv4 connections too.
+  setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+  sockaddr_in6 addr = {};
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, kNumWorkers) < 0) {
+    perror("listen");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}   // namespace ChunkStream
+}   // namespace Monitor
@@ -0,0 +1,56 @@
+#ifndef MONITOR_CHUNKSTREAM_H
+#define MONITOR_CHUNKSTREAM_H
+
+#include "Common/Event.h"
+#include "Common/Types.h"
+
+namespace Monitor {
+
+/** Wire format for streaming collected chunks to a remote monitor over TCP.
+ *  The sending monitor opens one connection per ingestor thread and starts it with a Hello. Each
+ *  chunk then follows as a FrameHeader and its num_events raw LoggedEvents, in host byte order:
+ *  both ends are expected to share an architecture. The receiver only ever writes
+ *  kProgramEnded back, once it decodes the end of the program, so that the sender can stop.
+ *  The sender ends a stream by shutting down its side; the receiver hangs up once it has read
+ *  everything, or right away when it stops.
+ *  Chunk stamps are on the sender's TSC. The receiver moves them onto its own, counting back from
+ *  when each frame arrives by how long before sending they were taken, so they don't depend on
+ *  the two clocks being related; only the time on the wire is left out.
+ */
+namespace ChunkStream {
+constexpr u32 kMagic = 0x4d435332;   // "MCS2"
+
+struct Hello {
+  u32 magic;
+  u32 stream_i;   // index of the sending ingestor thread, < kNumWorkers
+  double tsc_per_ns;   // rate of the sender's TSC
+};
+static_assert(sizeof(Hello) == 16);
+
+struct FrameHeader {
+  TraceId trace_id;
+  u32 num_events;
+  u64 produced_tsc;
+  u64 collected_tsc;
+  u64 sent_tsc;
+};
+static_assert(sizeof(FrameHeader) == 32);
+
+constexpr u8 kProgramEnded = 1;
+
+// How long a new connection has to send its Hello.
+constexpr int kHelloTimeoutMs = 1000;
+// How long the receiver waits for the rest of a sender's streams once the first has connected.
+constexpr int kConnectTimeoutMs = 10000;
+// How long a sender that ended its stream waits for the receiver to hang up.
+constexpr int kHangUpTimeoutMs = 30000;
+
+// Connects to `address` ("host:port"). Returns the socket, or -1 after printing why not.
+int Connect(const char* address);
+// Returns a socket listening on `port` on every interface, or -1 after printing why not.
+int Listen(u16 port);
+}   // namespace ChunkStream
+
+}   // namespace Monitor
+
+#endif